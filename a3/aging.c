@@ -0,0 +1,198 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Aging (NFU with decay), an approximation of LRU.
+ *
+ * Every frame has an AGING_BITS-bit age counter. A reference only marks the
+ * frame in a separate array of referenced flags. Every aging_tick references
+ * each counter is shifted right with the frame's flag shifted in at the top,
+ * and the flags are cleared, so a page's age holds its reference history
+ * over the last AGING_BITS ticks. The page with the smallest age is evicted.
+ *
+ * The ages and flags are contiguous arrays, so a tick and the search for
+ * the smallest age work on 32 bytes at a time using GCC vector types. On
+ * x86-64 both are compiled for both AVX2 and the baseline ISA (SSE2), and
+ * the version for the CPU the simulator runs on is chosen when it starts;
+ * elsewhere GCC lowers the vectors to whatever the target has.
+ */
+#include <stdint.h>
+#include <string.h>
+#include "pagetable.h"
+#include "sim.h"
+
+// Width of the age counters: 8, 16 or 32
+#define AGING_BITS 16
+
+#if AGING_BITS == 8
+typedef uint8_t age_t;
+#elif AGING_BITS == 16
+typedef uint16_t age_t;
+#else
+typedef uint32_t age_t;
+#endif
+
+#define AGE_TOP   ((age_t)1 << (AGING_BITS - 1))
+#define AGE_LANES (32 / sizeof(age_t))
+
+typedef age_t agevec_t __attribute__((vector_size(32)));
+typedef uint64_t u64vec_t __attribute__((vector_size(32)));
+
+#if defined(__x86_64__)
+#define AGE_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define AGE_CLONES
+#endif
+
+// References between ticks (sim -A); 0 means memsize references
+unsigned long aging_tick = 0;
+
+struct aging_data {
+	age_t *age;
+	age_t *refd;   // AGE_TOP if the frame was referenced since the last tick
+	unsigned long tick;
+};
+
+AGE_CLONES
+static void age_tick(age_t *age, age_t *refd, unsigned n)
+{
+	unsigned i = 0;
+	for (; i + AGE_LANES <= n; i += AGE_LANES) {
+		agevec_t *a = (agevec_t *)&age[i];
+		agevec_t *r = (agevec_t *)&refd[i];
+		*a = (*a >> 1) | *r;
+		*r = (agevec_t){0};
+	}
+	for (; i < n; i++) {
+		age[i] = (age[i] >> 1) | refd[i];
+		refd[i] = 0;
+	}
+}
+
+/* Returns the frame with the smallest age, counting a reference since the
+ * last tick as if the tick had just happened. The first pass finds the
+ * smallest value; the second finds the first block, then frame, holding it.
+ */
+AGE_CLONES
+static unsigned age_min(const age_t *age, const age_t *refd, unsigned n)
+{
+	age_t min = (age_t)~0;
+	unsigned i = 0;
+
+	if (n >= AGE_LANES) {
+		agevec_t vmin = ~(agevec_t){0};
+		for (; i + AGE_LANES <= n; i += AGE_LANES) {
+			agevec_t key = (*(agevec_t *)&age[i] >> 1) | *(agevec_t *)&refd[i];
+			agevec_t lt = (agevec_t)(key < vmin);
+			vmin = (key & lt) | (vmin & ~lt);
+		}
+		for (unsigned l = 0; l < AGE_LANES; l++) {
+			if (vmin[l] < min) {
+				min = vmin[l];
+			}
+		}
+	}
+	for (; i < n; i++) {
+		age_t key = (age[i] >> 1) | refd[i];
+		if (key < min) {
+			min = key;
+		}
+	}
+
+	agevec_t vmin = (agevec_t){0} + min;
+	for (i = 0; i + AGE_LANES <= n; i += AGE_LANES) {
+		agevec_t key = (*(agevec_t *)&age[i] >> 1) | *(agevec_t *)&refd[i];
+		u64vec_t eq = (u64vec_t)(key == vmin);
+		if (eq[0] | eq[1] | eq[2] | eq[3]) {
+			break;
+		}
+	}
+	for (; ; i++) {
+		if (((age[i] >> 1) | refd[i]) == min) {
+			return i;
+		}
+	}
+}
+
+/* Page to evict is chosen using the aging algorithm: the page with the
+ * smallest age.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int aging_evict(void)
+{
+	struct aging_data *a = sim->alg_data;
+	unsigned frame = age_min(a->age, a->refd, sim->memsize);
+
+	// The page brought into the frame starts with no history
+	a->age[frame] = 0;
+	a->refd[frame] = 0;
+	return frame;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the aging algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void aging_ref(pgtbl_entry_t *p)
+{
+	struct aging_data *a = sim->alg_data;
+
+	a->refd[p->frame >> PAGE_SHIFT] = AGE_TOP;
+	if (sim->ref_count % a->tick == 0) {
+		age_tick(a->age, a->refd, sim->memsize);
+	}
+}
+
+/* Called for a page brought in without a reference. It is not marked
+ * referenced, but starts out ranked with the pages last used in the
+ * previous tick, below any page used since, so that it is not the next
+ * victim before it has had a chance to be used (as CLOCK gives such a page
+ * one revolution of the hand).
+ */
+void aging_insert(pgtbl_entry_t *p)
+{
+	struct aging_data *a = sim->alg_data;
+	a->age[p->frame >> PAGE_SHIFT] = AGE_TOP;
+	a->refd[p->frame >> PAGE_SHIFT] = 0;
+}
+
+/* Initialize any data structures needed for this replacement algorithm. */
+void aging_init(void)
+{
+	struct aging_data *a = malloc(sizeof(struct aging_data));
+	size_t size = ((sim->memsize + AGE_LANES - 1) / AGE_LANES) * 32;
+	void *age, *refd;
+
+	// Aligned so every block of AGE_LANES counters is one aligned vector
+	if (a == NULL || posix_memalign(&age, 32, size) != 0 ||
+	    posix_memalign(&refd, 32, size) != 0) {
+		perror("aging_init: malloc");
+		exit(1);
+	}
+	memset(age, 0, size);
+	memset(refd, 0, size);
+	a->age = age;
+	a->refd = refd;
+	a->tick = aging_tick ? aging_tick : sim->memsize;
+	sim->alg_data = a;
+}
+
+/* Cleanup any data structures created in aging_init(). */
+void aging_cleanup(void)
+{
+	struct aging_data *a = sim->alg_data;
+	free(a->age);
+	free(a->refd);
+	free(a);
+}
@@ -0,0 +1,260 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* ARC (Adaptive Replacement Cache, Megiddo and Modha).
+ *
+ * Resident pages are kept on two LRU lists: T1 holds pages referenced once
+ * since they came into memory, T2 pages referenced at least twice. Evicted
+ * pages are remembered (by virtual page only) on the ghost lists B1 and B2.
+ * A miss that hits in B1 means T1 was too small, so the target size p of
+ * T1 grows; a miss that hits in B2 shrinks it. A long scan only passes
+ * through T1, so it cannot push the frequently used pages out of T2.
+ */
+#include "pagetable.h"
+#include "sim.h"
+#include "vpmap.h"
+
+enum { T1, T2, B1, B2, NUM_LISTS, NO_LIST = -1 };
+
+// Nodes 0..memsize-1 belong to the frames with the same numbers and are
+// on T1 or T2; nodes memsize..2*memsize-1 are ghosts, on B1 or B2.
+struct arc_node {
+	addr_t vpage;
+	int prev;    // Towards the MRU end, or -1
+	int next;    // Towards the LRU end, or -1
+	int list;
+};
+
+struct arc_list {
+	int mru;
+	int lru;
+	unsigned size;
+};
+
+struct arc_data {
+	struct arc_node *nodes;
+	struct arc_list lists[NUM_LISTS];
+	unsigned c;                // Cache size (memsize)
+	unsigned p;                // Target size of T1
+
+	int *free_ghosts;          // Stack of ghost nodes not on B1 or B2
+	unsigned num_free_ghosts;
+	struct vpmap *ghosts;      // vpage -> ghost node, for B1 and B2
+
+	// The miss being handled: arc_evict() looks at the ghost lists before
+	// choosing a victim, and arc_ref() then puts the page on miss_list.
+	int miss_pending;
+	addr_t miss_vpage;
+	int miss_list;
+	int miss_in_b2;
+	int discard_t1;            // Evict from T1 without keeping a ghost
+};
+
+static void list_remove(struct arc_data *a, int n)
+{
+	struct arc_node *node = &a->nodes[n];
+	struct arc_list *l = &a->lists[node->list];
+
+	if (node->prev != -1) {
+		a->nodes[node->prev].next = node->next;
+	} else {
+		l->mru = node->next;
+	}
+	if (node->next != -1) {
+		a->nodes[node->next].prev = node->prev;
+	} else {
+		l->lru = node->prev;
+	}
+	l->size--;
+	node->list = NO_LIST;
+}
+
+static void list_push_mru(struct arc_data *a, int list, int n)
+{
+	struct arc_node *node = &a->nodes[n];
+	struct arc_list *l = &a->lists[list];
+
+	node->list = list;
+	node->prev = -1;
+	node->next = l->mru;
+	if (l->mru != -1) {
+		a->nodes[l->mru].prev = n;
+	} else {
+		l->lru = n;
+	}
+	l->mru = n;
+	l->size++;
+}
+
+// Forgets the least recently used page on ghost list B1 or B2.
+static void ghost_drop_lru(struct arc_data *a, int list)
+{
+	int g = a->lists[list].lru;
+	list_remove(a, g);
+	vpmap_remove(a->ghosts, a->nodes[g].vpage);
+	a->free_ghosts[a->num_free_ghosts++] = g;
+}
+
+static void ghost_add(struct arc_data *a, int list, addr_t vpage)
+{
+	if (a->num_free_ghosts == 0) {
+		// Only possible if frames have been freed; keep B2 before B1
+		ghost_drop_lru(a, a->lists[B1].size ? B1 : B2);
+	}
+	int g = a->free_ghosts[--a->num_free_ghosts];
+	a->nodes[g].vpage = vpage;
+	list_push_mru(a, list, g);
+	vpmap_put(a->ghosts, vpage, g);
+}
+
+/* Looks up the missing page vpage on the ghost lists, adapts p, and trims
+ * the directory so it never holds more than 2c pages. Decides which list
+ * the page goes on when arc_ref() sees it.
+ */
+static void arc_miss(struct arc_data *a, addr_t vpage)
+{
+	struct arc_list *l = a->lists;
+	long g;
+
+	a->miss_pending = 1;
+	a->miss_vpage = vpage;
+	a->miss_in_b2 = 0;
+	a->discard_t1 = 0;
+
+	if (vpmap_get(a->ghosts, vpage, &g)) {
+		unsigned delta;
+		if (a->nodes[g].list == B1) {
+			delta = l[B1].size >= l[B2].size ? 1 : l[B2].size / l[B1].size;
+			a->p = a->p + delta < a->c ? a->p + delta : a->c;
+			sim->ghost_recent_hit_count++;
+		} else {
+			delta = l[B2].size >= l[B1].size ? 1 : l[B1].size / l[B2].size;
+			a->p = a->p > delta ? a->p - delta : 0;
+			a->miss_in_b2 = 1;
+			sim->ghost_frequent_hit_count++;
+		}
+		list_remove(a, g);
+		vpmap_remove(a->ghosts, vpage);
+		a->free_ghosts[a->num_free_ghosts++] = g;
+		a->miss_list = T2;
+		return;
+	}
+
+	// A page that has not been seen recently
+	a->miss_list = T1;
+	if (l[T1].size + l[B1].size >= a->c) {
+		if (l[B1].size > 0) {
+			ghost_drop_lru(a, B1);
+		} else {
+			a->discard_t1 = 1;
+		}
+	} else if (l[T1].size + l[T2].size + l[B1].size + l[B2].size >= 2 * a->c &&
+	           l[B2].size > 0) {
+		ghost_drop_lru(a, B2);
+	}
+}
+
+/* Page to evict is chosen using the ARC algorithm: the LRU page of T1 if
+ * T1 is larger than its target p, otherwise the LRU page of T2.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int arc_evict(void)
+{
+	struct arc_data *a = sim->alg_data;
+	struct arc_list *l = a->lists;
+
+	arc_miss(a, sim->fault_vaddr >> PAGE_SHIFT);
+
+	int from;
+	if (l[T1].size > 0 &&
+	    (l[T1].size > a->p || (a->miss_in_b2 && l[T1].size == a->p) ||
+	     l[T2].size == 0)) {
+		from = T1;
+	} else {
+		from = T2;
+	}
+
+	int frame = l[from].lru;
+	list_remove(a, frame);
+	if (!(from == T1 && a->discard_t1)) {
+		ghost_add(a, from == T1 ? B1 : B2, a->nodes[frame].vpage);
+	}
+	return frame;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the ARC algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void arc_ref(pgtbl_entry_t *p)
+{
+	struct arc_data *a = sim->alg_data;
+	int frame = p->frame >> PAGE_SHIFT;
+	struct arc_node *node = &a->nodes[frame];
+
+	if (node->list != NO_LIST) {
+		// Hit: the page has now been used more than once
+		list_remove(a, frame);
+		list_push_mru(a, T2, frame);
+		return;
+	}
+
+	// The page was just brought in. If a frame was free there was no
+	// eviction, so the ghost lists have not been checked yet.
+	addr_t vpage = sim->coremap[frame].vaddr >> PAGE_SHIFT;
+	if (!a->miss_pending || a->miss_vpage != vpage) {
+		arc_miss(a, vpage);
+	}
+	a->miss_pending = 0;
+	node->vpage = vpage;
+	list_push_mru(a, a->miss_list, frame);
+}
+
+/* Initialize any data structures needed for this replacement algorithm. */
+void arc_init(void)
+{
+	unsigned c = sim->memsize;
+	struct arc_data *a = calloc(1, sizeof(struct arc_data));
+	if (a == NULL ||
+	    (a->nodes = malloc(2 * c * sizeof(struct arc_node))) == NULL ||
+	    (a->free_ghosts = malloc(c * sizeof(int))) == NULL) {
+		perror("arc_init: malloc");
+		exit(1);
+	}
+	a->c = c;
+	a->p = 0;
+	for (int i = 0; i < NUM_LISTS; i++) {
+		a->lists[i].mru = a->lists[i].lru = -1;
+		a->lists[i].size = 0;
+	}
+	for (unsigned i = 0; i < 2 * c; i++) {
+		a->nodes[i].list = NO_LIST;
+	}
+	for (a->num_free_ghosts = 0; a->num_free_ghosts < c; a->num_free_ghosts++) {
+		a->free_ghosts[a->num_free_ghosts] = 2 * c - 1 - a->num_free_ghosts;
+	}
+	a->ghosts = vpmap_create(c);
+	sim->alg_data = a;
+}
+
+/* Cleanup any data structures created in arc_init(). */
+void arc_cleanup(void)
+{
+	struct arc_data *a = sim->alg_data;
+	vpmap_destroy(a->ghosts);
+	free(a->free_ghosts);
+	free(a->nodes);
+	free(a);
+}
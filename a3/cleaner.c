@@ -0,0 +1,107 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Background page cleaner, in the spirit of bdflush.
+ *
+ * A frame that is free or holds a clean page can be reclaimed without a
+ * write. The cleaner keeps enough of them around: it runs every
+ * cleaner_interval references, and also whenever the number of free or
+ * clean frames drops below the low watermark. Each run sweeps the frames
+ * from where the last one stopped and writes out dirty pages that have not
+ * been referenced for a whole interval (cold pages), until the free or
+ * clean frames reach the high watermark. The pages stay in memory, clean,
+ * so evicting them later is a clean eviction.
+ *
+ * If a run cannot reach the high watermark, because the dirty pages are
+ * all hot, the low watermark is ignored until the next periodic run, so
+ * the cleaner does not sweep on every reference.
+ */
+#include "pagetable.h"
+#include "sim.h"
+
+// References between runs (0 disables the cleaner), and the low and high
+// watermarks in percent of memory (sim -C interval[,low,high])
+unsigned long cleaner_interval = 0;
+unsigned cleaner_low = 10;
+unsigned cleaner_high = 20;
+
+struct cleaner {
+	unsigned hand;
+	unsigned long next_run;
+	unsigned low;        // Watermarks in frames
+	unsigned high;
+	int starved;         // The last run fell short of the high watermark
+};
+
+void cleaner_init(void)
+{
+	if (cleaner_interval == 0) {
+		sim->cleaner = NULL;
+		return;
+	}
+	if (cleaner_low > cleaner_high || cleaner_high > 100) {
+		fprintf(stderr, "Error: cleaner watermarks must be 0 <= low <= high <= 100\n");
+		exit(1);
+	}
+	struct cleaner *c = malloc(sizeof(struct cleaner));
+	if (c == NULL) {
+		perror("cleaner_init: malloc");
+		exit(1);
+	}
+	c->hand = 0;
+	c->next_run = cleaner_interval;
+	c->low = (unsigned long)sim->memsize * cleaner_low / 100;
+	c->high = (unsigned long)sim->memsize * cleaner_high / 100;
+	c->starved = 0;
+	sim->cleaner = c;
+}
+
+void cleaner_destroy(void)
+{
+	free(sim->cleaner);
+	sim->cleaner = NULL;
+}
+
+static void cleaner_run(struct cleaner *c)
+{
+	struct frame *coremap = sim->coremap;
+	unsigned long now = sim->ref_count;
+	unsigned clean = sim->memsize - sim->num_dirty;
+
+	for (unsigned i = 0; i < sim->memsize && clean < c->high; i++) {
+		struct frame *f = &coremap[c->hand];
+		if (f->in_use && (f->pte->frame & PG_DIRTY) &&
+		    now - f->last_ref >= cleaner_interval) {
+			clean_frame(c->hand);
+			clean++;
+		}
+		c->hand = (c->hand + 1) % sim->memsize;
+	}
+	c->starved = clean < c->high;
+	c->next_run = now + cleaner_interval;
+	sim->cleaner_run_count++;
+}
+
+/* Called before each reference. Runs the cleaner if its interval is up or
+ * the free or clean frames are below the low watermark.
+ */
+void cleaner_check(void)
+{
+	struct cleaner *c = sim->cleaner;
+
+	if ((unsigned long)sim->ref_count >= c->next_run ||
+	    (!c->starved && sim->memsize - sim->num_dirty < c->low)) {
+		cleaner_run(c);
+	}
+}
@@ -15,7 +15,9 @@
 #include "pagetable.h"
 #include "sim.h"
 
-int clock_hand;
+struct clock_data {
+	unsigned clock_hand;
+};
 
 /* Page to evict is chosen using the CLOCK algorithm.
  * Returns the page frame number (which is also the index in the coremap)
@@ -24,11 +26,56 @@ int clock_hand;
 int clock_evict(void)
 {
 	//TODO
-	while (coremap[clock_hand].pte->frame & PG_REF) { //while clock points to entry with ref bit 1
-		coremap[clock_hand].pte->frame &= ~PG_REF; // set ref to 0
-		clock_hand = (clock_hand + 1) % memsize; // loops around the clock 
+	struct clock_data *c = sim->alg_data;
+	struct frame *coremap = sim->coremap;
+	while (coremap[c->clock_hand].pte->frame & PG_REF) { //while clock points to entry with ref bit 1
+		coremap[c->clock_hand].pte->frame &= ~PG_REF; // set ref to 0
+		c->clock_hand = (c->clock_hand + 1) % sim->memsize; // loops around the clock 
+	}
+	return c->clock_hand;
+}
+
+/* Chooses up to max victims in one sweep of the hand, which moves past
+ * each victim. The sweep stops after one revolution once it has found a
+ * victim, so a frame is never chosen twice. Returns the number chosen.
+ */
+unsigned clock_evict_batch(unsigned *frames, unsigned max)
+{
+	struct clock_data *c = sim->alg_data;
+	struct frame *coremap = sim->coremap;
+	unsigned n = 0;
+
+	for (unsigned steps = 0; n < max && (n == 0 || steps < sim->memsize); steps++) {
+		pgtbl_entry_t *p = coremap[c->clock_hand].pte;
+		if (p->frame & PG_REF) {
+			p->frame &= ~PG_REF;
+		} else {
+			frames[n++] = c->clock_hand;
+		}
+		c->clock_hand = (c->clock_hand + 1) % sim->memsize;
+	}
+	return n;
+}
+
+/* Chooses a victim among the frames holding pages of process pid, for
+ * local replacement. The hand passes over other processes' frames without
+ * clearing their reference bits.
+ */
+int clock_evict_proc(unsigned pid)
+{
+	struct clock_data *c = sim->alg_data;
+	struct frame *coremap = sim->coremap;
+
+	for (;;) {
+		pgtbl_entry_t *p = coremap[c->clock_hand].pte;
+		if (VADDR_PID(coremap[c->clock_hand].vaddr) == pid) {
+			if (!(p->frame & PG_REF)) {
+				return c->clock_hand;
+			}
+			p->frame &= ~PG_REF;
+		}
+		c->clock_hand = (c->clock_hand + 1) % sim->memsize;
 	}
-	return clock_hand;
 }
 
 /* This function is called on each access to a page to update any information
@@ -40,14 +87,30 @@ void clock_ref(pgtbl_entry_t *p)
 	p->frame |= PG_REF; // set ref bit to one
 }
 
+/* Called for a page brought in without a reference. It is left with its
+ * ref bit clear, so it is evicted the next time the hand reaches it unless
+ * it has been used by then. clock_evict() leaves the hand on the victim's
+ * frame, so the hand is moved past the page to give it a full revolution.
+ */
+void clock_insert(pgtbl_entry_t *p)
+{
+	struct clock_data *c = sim->alg_data;
+	if (c->clock_hand == p->frame >> PAGE_SHIFT) {
+		c->clock_hand = (c->clock_hand + 1) % sim->memsize;
+	}
+}
+
 /* Initialize any data structures needed for this replacement algorithm. */
 void clock_init(void)
 {
-	clock_hand = 0;
+	struct clock_data *c = malloc(sizeof(struct clock_data));
+	c->clock_hand = 0;
+	sim->alg_data = c;
 }
 
 /* Cleanup any data structures created in clock_init(). */
 void clock_cleanup(void)
 {
 	//TODO
+	free(sim->alg_data);
 }
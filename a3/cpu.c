@@ -0,0 +1,203 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Concurrent replay: several simulated CPUs, one thread each, replay parts
+ * of the trace at the same time against one shared memory, coremap, set of
+ * page tables and swap area.
+ *
+ * The trace is cut into blocks of CPU_BLOCK references, dealt out to the
+ * CPUs in turn, so each CPU replays its own stream of references.
+ *
+ * Page faults and evictions, and every call into the replacement
+ * algorithm, are serialised by one memory lock. Algorithms whose hits only
+ * set PG_REF (ref_mode REF_ATOMIC, such as clock) let a hit skip the lock:
+ * the CPU pins the frame and sets PG_REF with an atomic compare-and-swap
+ * (see pin_frame()). For the other algorithms every reference takes the
+ * lock, so the lock statistics show how each one scales.
+ *
+ * The TLB, readahead, the page cleaner and huge pages belong to a single
+ * CPU, so they cannot be used with several.
+ */
+#include <pthread.h>
+#include "pagetable.h"
+#include "sim.h"
+#include "trace.h"
+
+#define CPU_BLOCK 256
+
+// Number of simulated CPUs (sim -c); 0 or 1 replays on the main thread
+unsigned num_cpus = 0;
+
+struct cpu {
+	pthread_t thread;
+	struct sim *sim;
+	unsigned id;
+
+	// Lock-free hits, in total and by PID, added into the simulation's
+	// counters when the replay ends
+	int hit_count;
+	int *proc_hits;
+
+	unsigned long lock_count;      // Memory lock acquisitions
+	unsigned long contended_count; // ...that had to wait for it
+};
+
+struct cpus {
+	pthread_mutex_t lock;
+	struct cpu *cpu;
+	unsigned long lock_count;
+	unsigned long contended_count;
+	int fast_hit_count;
+};
+
+void cpu_init(void)
+{
+	if (num_cpus <= 1) {
+		sim->cpus = NULL;
+		return;
+	}
+	if (sim->alg.ref_mode == REF_SERIAL) {
+		fprintf(stderr, "Error: %s does not support several CPUs\n", sim->alg.name);
+		exit(1);
+	}
+	if (sim->tlb || sim->ra || sim->cleaner || sim->huge) {
+		fprintf(stderr, "Error: the TLB, readahead, page cleaner and huge pages do not support several CPUs\n");
+		exit(1);
+	}
+	struct cpus *c = calloc(1, sizeof(struct cpus));
+	if (c == NULL || (c->cpu = calloc(num_cpus, sizeof(struct cpu))) == NULL) {
+		perror("cpu_init: malloc");
+		exit(1);
+	}
+	pthread_mutex_init(&c->lock, NULL);
+	sim->cpus = c;
+}
+
+void cpu_destroy(void)
+{
+	struct cpus *c = sim->cpus;
+	if (c == NULL) {
+		return;
+	}
+	pthread_mutex_destroy(&c->lock);
+	free(c->cpu);
+	free(c);
+	sim->cpus = NULL;
+}
+
+static void mm_lock(struct cpus *c, struct cpu *cpu)
+{
+	if (pthread_mutex_trylock(&c->lock) != 0) {
+		cpu->contended_count++;
+		pthread_mutex_lock(&c->lock);
+	}
+	cpu->lock_count++;
+}
+
+static void *cpu_main(void *arg)
+{
+	struct cpu *cpu = arg;
+	sim = cpu->sim;
+	struct cpus *c = sim->cpus;
+	const trace_rec_t *recs = sim->trace->recs;
+	uint64_t nrecs = sim->trace->nrecs;
+	int lockless = sim->alg.ref_mode == REF_ATOMIC;
+
+	for (uint64_t start = (uint64_t)cpu->id * CPU_BLOCK; start < nrecs;
+	     start += (uint64_t)num_cpus * CPU_BLOCK) {
+		uint64_t end = start + CPU_BLOCK < nrecs ? start + CPU_BLOCK : nrecs;
+		for (uint64_t i = start; i < end; i++) {
+			char type = TRACE_REC_TYPE(recs[i]);
+			addr_t vaddr = TRACE_REC_VADDR(recs[i]);
+			int frame;
+
+			if (lockless && (frame = pin_frame(vaddr, type)) >= 0) {
+				access_page(&sim->physmem[frame * SIMPAGESIZE], type, vaddr);
+				unpin_frame(frame);
+				cpu->hit_count++;
+				cpu->proc_hits[VADDR_PID(vaddr)]++;
+				continue;
+			}
+			mm_lock(c, cpu);
+			access_page(find_physpage(vaddr, type), type, vaddr);
+			pthread_mutex_unlock(&c->lock);
+		}
+	}
+	return NULL;
+}
+
+/* Replays the whole trace through simulation s on num_cpus threads. */
+void cpu_run(struct sim *s)
+{
+	struct cpus *c = s->cpus;
+	struct trace *t = s->trace;
+
+	if (trace_load(t) != 0) {
+		exit(1);
+	}
+
+	// The process table must not move during the replay (see
+	// reserve_procs()), so make room for every PID in the trace now
+	unsigned max_pid = 0;
+	for (uint64_t i = 0; i < t->nrecs; i++) {
+		unsigned pid = VADDR_PID(TRACE_REC_VADDR(t->recs[i]));
+		if (pid > max_pid) {
+			max_pid = pid;
+		}
+	}
+	reserve_procs(max_pid);
+
+	for (unsigned i = 0; i < num_cpus; i++) {
+		struct cpu *cpu = &c->cpu[i];
+		cpu->sim = s;
+		cpu->id = i;
+		if ((cpu->proc_hits = calloc(max_pid + 1, sizeof(int))) == NULL) {
+			perror("cpu_run: calloc");
+			exit(1);
+		}
+		if (pthread_create(&cpu->thread, NULL, cpu_main, cpu) != 0) {
+			fprintf(stderr, "Failed to start CPU thread\n");
+			exit(1);
+		}
+	}
+
+	for (unsigned i = 0; i < num_cpus; i++) {
+		struct cpu *cpu = &c->cpu[i];
+		pthread_join(cpu->thread, NULL);
+
+		s->hit_count += cpu->hit_count;
+		s->ref_count += cpu->hit_count;
+		for (unsigned pid = 0; pid <= max_pid; pid++) {
+			s->procs[pid].hit_count += cpu->proc_hits[pid];
+		}
+		free(cpu->proc_hits);
+		c->fast_hit_count += cpu->hit_count;
+		c->lock_count += cpu->lock_count;
+		c->contended_count += cpu->contended_count;
+	}
+}
+
+/* Prints the concurrency statistics, if several CPUs were used. */
+void cpu_print_stats(struct sim *s)
+{
+	struct cpus *c = s->cpus;
+	if (c == NULL) {
+		return;
+	}
+	printf("CPUs: %u\n", num_cpus);
+	printf("Lock-free hits: %d\n", c->fast_hit_count);
+	printf("Memory lock acquisitions: %lu (%lu contended)\n",
+	       c->lock_count, c->contended_count);
+	printf("Replay rate: %.0f references/s\n", s->ref_count / s->replay_time);
+}
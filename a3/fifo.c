@@ -15,7 +15,34 @@
 #include "pagetable.h"
 #include "sim.h"
 
-int idx;
+#define NIL (-1)
+
+/* The frames in use, in the order their pages were brought in: a page
+ * joins the tail of the queue on its first reference (or when it is taken
+ * in without one), and the victim is the frame at the head. The order does
+ * not depend on which frames pages are put in.
+ */
+struct fifo_data {
+	int *next;     // Next frame in the queue, NIL at the tail
+	int *prev;     // Previous frame in the queue, NIL at the head
+	char *queued;
+	int head, tail;
+};
+
+static void dequeue(struct fifo_data *f, int frame)
+{
+	if (f->prev[frame] != NIL) {
+		f->next[f->prev[frame]] = f->next[frame];
+	} else {
+		f->head = f->next[frame];
+	}
+	if (f->next[frame] != NIL) {
+		f->prev[f->next[frame]] = f->prev[frame];
+	} else {
+		f->tail = f->prev[frame];
+	}
+	f->queued[frame] = 0;
+}
 
 /* Page to evict is chosen using the FIFO algorithm.
  * Returns the page frame number (which is also the index in the coremap)
@@ -23,9 +50,37 @@ int idx;
  */
 int fifo_evict(void)
 {
-	//TODO
-	idx = (idx + 1) % memsize;
-	return idx;
+	struct fifo_data *f = sim->alg_data;
+	int frame = f->head;
+	dequeue(f, frame);
+	return frame;
+}
+
+/* Chooses the max oldest frames at once. Returns the number chosen. */
+unsigned fifo_evict_batch(unsigned *frames, unsigned max)
+{
+	struct fifo_data *f = sim->alg_data;
+	unsigned n = 0;
+
+	while (n < max && f->head != NIL) {
+		frames[n++] = fifo_evict();
+	}
+	return n;
+}
+
+/* Chooses the oldest frame holding a page of process pid, for local
+ * replacement. Other processes' frames keep their places in the queue.
+ */
+int fifo_evict_proc(unsigned pid)
+{
+	struct fifo_data *f = sim->alg_data;
+	int frame = f->head;
+
+	while (VADDR_PID(sim->coremap[frame].vaddr) != pid) {
+		frame = f->next[frame];
+	}
+	dequeue(f, frame);
+	return frame;
 }
 
 /* This function is called on each access to a page to update any information
@@ -34,20 +89,45 @@ int fifo_evict(void)
  */
 void fifo_ref(pgtbl_entry_t *p)
 {
-	(void)p;
-	//TODO
+	struct fifo_data *f = sim->alg_data;
+	int frame = p->frame >> PAGE_SHIFT;
+
+	if (f->queued[frame]) {
+		return;
+	}
+	// The page was just brought in
+	f->next[frame] = NIL;
+	f->prev[frame] = f->tail;
+	if (f->tail != NIL) {
+		f->next[f->tail] = frame;
+	} else {
+		f->head = frame;
+	}
+	f->tail = frame;
+	f->queued[frame] = 1;
 }
 
 /* Initialize any data structures needed for this replacement algorithm. */
 void fifo_init(void)
 {
-	//TODO
-	idx = -1;
-
+	struct fifo_data *f = malloc(sizeof(struct fifo_data));
+	if (f == NULL ||
+	    (f->next = malloc(sim->memsize * sizeof(int))) == NULL ||
+	    (f->prev = malloc(sim->memsize * sizeof(int))) == NULL ||
+	    (f->queued = calloc(sim->memsize, 1)) == NULL) {
+		perror("fifo_init: malloc");
+		exit(1);
+	}
+	f->head = f->tail = NIL;
+	sim->alg_data = f;
 }
 
 /* Cleanup any data structures created in fifo_init(). */
 void fifo_cleanup(void)
 {
-	//TODO
+	struct fifo_data *f = sim->alg_data;
+	free(f->next);
+	free(f->prev);
+	free(f->queued);
+	free(f);
 }
@@ -0,0 +1,334 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Transparent huge pages, with reservations as in FreeBSD's superpages.
+ *
+ * A huge page spans one leaf page table (512 pages, 2MB, with the default
+ * four levels) and is mapped by the directory entry above it, with
+ * PG_HUGE set. Its frames must be one aligned block of memory, with each
+ * base page in its own place in the block.
+ *
+ * The first fault on a region that spans one huge page reserves a free
+ * block for it, if there is one, and each page of the region that is
+ * brought in later goes in its own frame of the block. Once
+ * huge_threshold percent of the block is in use, the rest of the region
+ * is brought in (from swap, or zero-filled) and the region is promoted.
+ * No page is ever moved, so what the replacement algorithm knows about
+ * each frame stays correct. Pages are not put in frames in the order they
+ * are brought in, though, so an algorithm cannot take frame order for
+ * arrival order (FIFO keeps a queue of its own).
+ *
+ * Under memory pressure, the frames of reservations that are not yet
+ * full are given back before any page is evicted, fewest pages in use
+ * first. When the replacement algorithm picks a page in a huge page, the
+ * huge page is demoted: its dirty pages are written to swap together,
+ * with one clustered write, and its pages stay in memory as base pages,
+ * so the victim and the rest of them can be evicted clean.
+ */
+#include <assert.h>
+#include "pagetable.h"
+#include "sim.h"
+#include "vpmap.h"
+
+#define HUGE_NONE ((addr_t)-1)
+
+// Percent of a region that must be in memory before it is promoted to a
+// huge page (sim -H); 0 disables huge pages
+unsigned huge_threshold = 0;
+
+// An aligned block of memory that can hold one huge page
+struct block {
+	addr_t region;       // Region it is reserved for, or HUGE_NONE
+	pgdir_entry_t *pde;  // Directory entry mapping it, if huge
+	unsigned used;       // Frames in use
+	char huge;
+};
+
+struct huge {
+	unsigned span_bits;  // A huge page is 2^span_bits base pages
+	unsigned span;
+	unsigned threshold;  // Frames in use that trigger promotion
+	struct block *blocks;
+	unsigned nblocks;
+	unsigned nempty;     // Blocks with no frames in use or reserved
+	unsigned nreserved;  // Blocks reserved, huge or not
+	struct vpmap *regions; // Region -> reserved block
+	unsigned *dirty;     // Dirty frames of a huge page being demoted
+};
+
+static struct block *block_of(struct huge *h, unsigned frame)
+{
+	unsigned i = frame >> h->span_bits;
+	return i < h->nblocks ? &h->blocks[i] : NULL;
+}
+
+static unsigned block_base(struct huge *h, struct block *b)
+{
+	return (unsigned)(b - h->blocks) << h->span_bits;
+}
+
+void huge_init(void)
+{
+	if (huge_threshold == 0) {
+		sim->huge = NULL;
+		return;
+	}
+	if (huge_threshold > 100) {
+		fprintf(stderr, "Error: huge page threshold must be at most 100 percent\n");
+		exit(1);
+	}
+	struct huge *h = malloc(sizeof(struct huge));
+	if (h == NULL) {
+		perror("huge_init: malloc");
+		exit(1);
+	}
+	h->span_bits = sim->pt_bits[pt_levels - 1];
+	h->span = 1U << h->span_bits;
+	h->threshold = (h->span * huge_threshold + 99) / 100;
+	h->nblocks = sim->memsize >> h->span_bits;
+	if (h->nblocks == 0) {
+		fprintf(stderr, "Error: memory is smaller than one huge page (%u frames)\n",
+		        h->span);
+		exit(1);
+	}
+	if ((h->blocks = calloc(h->nblocks, sizeof(struct block))) == NULL ||
+	    (h->dirty = malloc(h->span * sizeof(unsigned))) == NULL) {
+		perror("huge_init: malloc");
+		exit(1);
+	}
+	for (unsigned i = 0; i < h->nblocks; i++) {
+		h->blocks[i].region = HUGE_NONE;
+	}
+	h->nempty = h->nblocks;
+	h->nreserved = 0;
+	h->regions = vpmap_create(h->nblocks);
+	sim->huge = h;
+}
+
+void huge_destroy(void)
+{
+	struct huge *h = sim->huge;
+	if (h == NULL) {
+		return;
+	}
+	vpmap_destroy(h->regions);
+	free(h->blocks);
+	free(h->dirty);
+	free(h);
+	sim->huge = NULL;
+}
+
+/* Reserves an empty block for region, taking its frames off the free
+ * frame stack. Returns NULL if there is no empty block.
+ */
+static struct block *reserve(struct huge *h, addr_t region)
+{
+	struct block *b = NULL;
+
+	if (h->nempty == 0) {
+		return NULL;
+	}
+	for (unsigned i = 0; i < h->nblocks && b == NULL; i++) {
+		if (h->blocks[i].used == 0 && h->blocks[i].region == HUGE_NONE) {
+			b = &h->blocks[i];
+		}
+	}
+	assert(b != NULL);
+
+	unsigned base = block_base(h, b);
+	unsigned n = 0;
+	for (unsigned i = 0; i < sim->num_free; i++) {
+		unsigned frame = sim->free_frames[i];
+		if (frame - base >= h->span) {
+			sim->free_frames[n++] = frame;
+		}
+	}
+	assert(sim->num_free - n == h->span);
+	sim->num_free = n;
+
+	b->region = region;
+	vpmap_put(h->regions, region, b - h->blocks);
+	h->nempty--;
+	h->nreserved++;
+	return b;
+}
+
+/* Gives up b's reservation, putting its free frames back on the stack. */
+static void unreserve(struct huge *h, struct block *b)
+{
+	unsigned base = block_base(h, b);
+
+	assert(!b->huge);
+	for (unsigned i = h->span; i-- > 0; ) {
+		if (!sim->coremap[base + i].in_use) {
+			sim->free_frames[sim->num_free++] = base + i;
+		}
+	}
+	vpmap_remove(h->regions, b->region);
+	b->region = HUGE_NONE;
+	h->nreserved--;
+	if (b->used == 0) {
+		h->nempty++;
+	}
+}
+
+/* Maps b as base pages again, writing out its dirty pages together. */
+static void demote(struct huge *h, struct block *b)
+{
+	unsigned base = block_base(h, b);
+	unsigned n = 0;
+
+	b->pde->pde &= ~(uintptr_t)PG_HUGE;
+	b->huge = 0;
+	if (sim->tlb) {
+		tlb_invalidate_huge(b->region);
+	}
+	for (unsigned i = 0; i < h->span; i++) {
+		if (sim->coremap[base + i].pte->frame & PG_DIRTY) {
+			h->dirty[n++] = base + i;
+		}
+	}
+	if (n > 0) {
+		clean_frames(h->dirty, n);
+	}
+	sim->huge_demote_count++;
+}
+
+/* Returns the frame reserved for the page at vaddr, reserving a block for
+ * its region first if it has none, or -1 if there is no block for it.
+ */
+int huge_alloc_frame(addr_t vaddr)
+{
+	struct huge *h = sim->huge;
+	addr_t vpage = vaddr >> PAGE_SHIFT;
+	addr_t region = vpage >> h->span_bits;
+	struct block *b;
+	long i;
+
+	if (vpmap_get(h->regions, region, &i)) {
+		b = &h->blocks[i];
+	} else if ((b = reserve(h, region)) == NULL) {
+		return -1;
+	}
+	// The page is not in memory, so a huge page cannot map it
+	assert(!b->huge);
+	return block_base(h, b) + (vpage & (h->span - 1));
+}
+
+/* Called when frame is put to use. */
+void huge_frame_used(unsigned frame)
+{
+	struct huge *h = sim->huge;
+	struct block *b = block_of(h, frame);
+
+	if (b && b->used++ == 0 && b->region == HUGE_NONE) {
+		h->nempty--;
+	}
+}
+
+/* Called when the page in frame is evicted. */
+void huge_frame_freed(unsigned frame)
+{
+	struct huge *h = sim->huge;
+	struct block *b = block_of(h, frame);
+
+	if (b && --b->used == 0 && b->region == HUGE_NONE) {
+		h->nempty++;
+	}
+}
+
+/* Called when there are no free frames outside reservations. Gives up the
+ * reservation with the fewest frames in use, if any has a free frame.
+ * Returns 1 if frames were freed, or 0 if a page must be evicted.
+ */
+int huge_break_reservation(void)
+{
+	struct huge *h = sim->huge;
+	struct block *victim = NULL;
+
+	if (h->nreserved == 0) {
+		return 0;
+	}
+	for (unsigned i = 0; i < h->nblocks; i++) {
+		struct block *b = &h->blocks[i];
+		if (b->region != HUGE_NONE && !b->huge && b->used < h->span &&
+		    (victim == NULL || b->used < victim->used)) {
+			victim = b;
+		}
+	}
+	if (victim == NULL) {
+		return 0;
+	}
+	unreserve(h, victim);
+	sim->huge_break_count++;
+	return 1;
+}
+
+/* Called before the page in frame is evicted. If it is part of a huge
+ * page, the huge page is demoted; either way its block is no longer
+ * reserved.
+ */
+void huge_evicting(unsigned frame)
+{
+	struct huge *h = sim->huge;
+	struct block *b = block_of(h, frame);
+
+	if (b == NULL || b->region == HUGE_NONE) {
+		return;
+	}
+	if (b->huge) {
+		demote(h, b);
+	}
+	unreserve(h, b);
+}
+
+/* Called after the page at vaddr, whose pte is p, is brought in on a
+ * fault. Promotes its region if enough of the region's block is in use
+ * and none of the region's pages is in memory outside the block.
+ */
+void huge_fault(addr_t vaddr, pgtbl_entry_t *p)
+{
+	struct huge *h = sim->huge;
+	addr_t vpage = vaddr >> PAGE_SHIFT;
+	addr_t region = vpage >> h->span_bits;
+	long i;
+
+	if (!vpmap_get(h->regions, region, &i)) {
+		return;
+	}
+	struct block *b = &h->blocks[i];
+	if (b->huge || b->used < h->threshold) {
+		return;
+	}
+
+	// Every page of the region is in the same leaf table
+	pgtbl_entry_t *leaf = p - (vpage & (h->span - 1));
+	unsigned base = block_base(h, b);
+	for (unsigned j = 0; j < h->span; j++) {
+		if (!sim->coremap[base + j].in_use && (leaf[j].frame & PG_VALID)) {
+			return;
+		}
+	}
+	for (unsigned j = 0; j < h->span; j++) {
+		if (!sim->coremap[base + j].in_use) {
+			fill_page(&leaf[j], ((region << h->span_bits) + j) << PAGE_SHIFT);
+			sim->huge_fill_count++;
+		}
+	}
+
+	b->pde = leaf_pde(vaddr);
+	b->pde->pde |= PG_HUGE;
+	b->huge = 1;
+	sim->huge_promote_count++;
+}
@@ -0,0 +1,319 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* LIRS (Low Inter-reference Recency Set, Jiang and Zhang).
+ *
+ * Pages with a short reuse distance are LIR pages and stay in memory; the
+ * rest are HIR pages, and only a small part of memory (hir_max frames)
+ * holds resident HIR pages, on the FIFO queue Q. The stack S orders pages
+ * by recency and always has an LIR page at the bottom. An HIR page that is
+ * referenced again while it is still in S has a shorter reuse distance
+ * than the oldest LIR page, so the two swap status. S also keeps entries
+ * for HIR pages that have been evicted, so a loop slightly larger than
+ * memory still gets most of its pages made LIR, where LRU gets none.
+ *
+ * All the state is in arrays indexed by node. Nodes 0..memsize-1 belong to
+ * the frames with the same numbers. Nodes from memsize up are the entries
+ * for evicted HIR pages, at most memsize of them, found by virtual page
+ * through a vpmap.
+ */
+#include "pagetable.h"
+#include "sim.h"
+#include "vpmap.h"
+
+enum { FREE, LIR, HIR, HIR_NONRES };
+
+struct lirs_data {
+	unsigned memsize;
+	char *status;
+	char *in_stack;
+	addr_t *vpage;
+
+	// Stack S, from top (most recent) to bottom
+	int *s_prev;
+	int *s_next;
+	int s_top;
+	int s_bottom;
+
+	// Q holds the resident HIR pages, from front (next victim) to end.
+	// The non-resident HIR entries use the same links for a FIFO of their
+	// own, so the oldest one can be dropped when there are too many.
+	int *q_prev;
+	int *q_next;
+	int q_front;
+	int q_end;
+	int nr_oldest;
+	int nr_newest;
+
+	unsigned lir_count;
+	unsigned lir_max;
+	int *free_nonres;    // Stack of unused non-resident nodes
+	unsigned num_free_nonres;
+	struct vpmap *nonres; // vpage -> node, for non-resident HIR pages
+};
+
+static void unlink_node(int *prev, int *next, int *first, int *last, int n)
+{
+	if (prev[n] != -1) {
+		next[prev[n]] = next[n];
+	} else {
+		*first = next[n];
+	}
+	if (next[n] != -1) {
+		prev[next[n]] = prev[n];
+	} else {
+		*last = prev[n];
+	}
+}
+
+static void push_first(int *prev, int *next, int *first, int *last, int n)
+{
+	prev[n] = -1;
+	next[n] = *first;
+	if (*first != -1) {
+		prev[*first] = n;
+	} else {
+		*last = n;
+	}
+	*first = n;
+}
+
+static void push_last(int *prev, int *next, int *first, int *last, int n)
+{
+	next[n] = -1;
+	prev[n] = *last;
+	if (*last != -1) {
+		next[*last] = n;
+	} else {
+		*first = n;
+	}
+	*last = n;
+}
+
+static void stack_remove(struct lirs_data *l, int n)
+{
+	unlink_node(l->s_prev, l->s_next, &l->s_top, &l->s_bottom, n);
+	l->in_stack[n] = 0;
+}
+
+static void stack_push(struct lirs_data *l, int n)
+{
+	push_first(l->s_prev, l->s_next, &l->s_top, &l->s_bottom, n);
+	l->in_stack[n] = 1;
+}
+
+// Frees a non-resident node, which must already be out of S.
+static void nonres_free(struct lirs_data *l, int n)
+{
+	unlink_node(l->q_prev, l->q_next, &l->nr_oldest, &l->nr_newest, n);
+	vpmap_remove(l->nonres, l->vpage[n]);
+	l->status[n] = FREE;
+	l->free_nonres[l->num_free_nonres++] = n;
+}
+
+/* Removes HIR entries from the bottom of S until an LIR page is there.
+ * A resident HIR page stays on Q; a non-resident one is forgotten.
+ */
+static void stack_prune(struct lirs_data *l)
+{
+	while (l->s_bottom != -1 && l->status[l->s_bottom] != LIR) {
+		int n = l->s_bottom;
+		stack_remove(l, n);
+		if (l->status[n] == HIR_NONRES) {
+			nonres_free(l, n);
+		}
+	}
+}
+
+// Turns the LIR page at the bottom of S into a resident HIR page at the
+// end of Q, to make room for a new LIR page.
+static void demote_bottom(struct lirs_data *l)
+{
+	int n = l->s_bottom;
+	stack_remove(l, n);
+	l->status[n] = HIR;
+	l->lir_count--;
+	push_last(l->q_prev, l->q_next, &l->q_front, &l->q_end, n);
+	stack_prune(l);
+}
+
+/* Page to evict is chosen using the LIRS algorithm: the resident HIR page
+ * at the front of Q. If it is still in S, S keeps an entry for it.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int lirs_evict(void)
+{
+	struct lirs_data *l = sim->alg_data;
+	int frame = l->q_front;
+
+	if (frame == -1) {
+		// Only if every frame holds an LIR page (memory of one frame)
+		frame = l->s_bottom;
+		stack_remove(l, frame);
+		l->lir_count--;
+		l->status[frame] = FREE;
+		return frame;
+	}
+	unlink_node(l->q_prev, l->q_next, &l->q_front, &l->q_end, frame);
+	l->status[frame] = FREE;
+
+	if (l->in_stack[frame]) {
+		if (l->num_free_nonres == 0) {
+			int old = l->nr_oldest;
+			stack_remove(l, old);
+			nonres_free(l, old);
+		}
+		// The new node takes the frame's place in S
+		int n = l->free_nonres[--l->num_free_nonres];
+		l->vpage[n] = l->vpage[frame];
+		l->status[n] = HIR_NONRES;
+		l->s_prev[n] = l->s_prev[frame];
+		l->s_next[n] = l->s_next[frame];
+		l->in_stack[n] = 1;
+		if (l->s_prev[n] != -1) {
+			l->s_next[l->s_prev[n]] = n;
+		} else {
+			l->s_top = n;
+		}
+		if (l->s_next[n] != -1) {
+			l->s_prev[l->s_next[n]] = n;
+		} else {
+			l->s_bottom = n;
+		}
+		l->in_stack[frame] = 0;
+		push_last(l->q_prev, l->q_next, &l->nr_oldest, &l->nr_newest, n);
+		vpmap_put(l->nonres, l->vpage[n], n);
+	}
+	return frame;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the LIRS algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void lirs_ref(pgtbl_entry_t *p)
+{
+	struct lirs_data *l = sim->alg_data;
+	int frame = p->frame >> PAGE_SHIFT;
+
+	switch (l->status[frame]) {
+	case LIR: {
+		int was_bottom = frame == l->s_bottom;
+		stack_remove(l, frame);
+		stack_push(l, frame);
+		if (was_bottom) {
+			stack_prune(l);
+		}
+		return;
+	}
+	case HIR:
+		if (l->in_stack[frame]) {
+			// Its reuse distance beats the bottom LIR page's
+			stack_remove(l, frame);
+			stack_push(l, frame);
+			unlink_node(l->q_prev, l->q_next, &l->q_front, &l->q_end, frame);
+			l->status[frame] = LIR;
+			l->lir_count++;
+			demote_bottom(l);
+		} else {
+			stack_push(l, frame);
+			unlink_node(l->q_prev, l->q_next, &l->q_front, &l->q_end, frame);
+			push_last(l->q_prev, l->q_next, &l->q_front, &l->q_end, frame);
+		}
+		return;
+	}
+
+	// The page was just brought in
+	addr_t vpage = sim->coremap[frame].vaddr >> PAGE_SHIFT;
+	long n;
+	l->vpage[frame] = vpage;
+	if (vpmap_get(l->nonres, vpage, &n)) {
+		sim->ghost_recent_hit_count++;
+		stack_remove(l, n);
+		nonres_free(l, n);
+		stack_push(l, frame);
+		l->status[frame] = LIR;
+		l->lir_count++;
+		if (l->lir_count > l->lir_max) {
+			demote_bottom(l);
+		}
+	} else if (l->lir_count < l->lir_max) {
+		// Until the LIR set is full, every page is LIR
+		stack_push(l, frame);
+		l->status[frame] = LIR;
+		l->lir_count++;
+	} else {
+		stack_push(l, frame);
+		l->status[frame] = HIR;
+		push_last(l->q_prev, l->q_next, &l->q_front, &l->q_end, frame);
+	}
+}
+
+/* Initialize any data structures needed for this replacement algorithm. */
+void lirs_init(void)
+{
+	unsigned memsize = sim->memsize;
+	unsigned nodes = 2 * memsize;
+	struct lirs_data *l = calloc(1, sizeof(struct lirs_data));
+	if (l == NULL) {
+		perror("lirs_init: calloc");
+		exit(1);
+	}
+
+	l->memsize = memsize;
+	l->status = calloc(nodes, sizeof(char));
+	l->in_stack = calloc(nodes, sizeof(char));
+	l->vpage = malloc(nodes * sizeof(addr_t));
+	l->s_prev = malloc(nodes * sizeof(int));
+	l->s_next = malloc(nodes * sizeof(int));
+	l->q_prev = malloc(nodes * sizeof(int));
+	l->q_next = malloc(nodes * sizeof(int));
+	l->free_nonres = malloc(memsize * sizeof(int));
+	if (l->status == NULL || l->in_stack == NULL || l->vpage == NULL ||
+	    l->s_prev == NULL || l->s_next == NULL || l->q_prev == NULL ||
+	    l->q_next == NULL || l->free_nonres == NULL) {
+		perror("lirs_init: malloc");
+		exit(1);
+	}
+	l->s_top = l->s_bottom = -1;
+	l->q_front = l->q_end = -1;
+	l->nr_oldest = l->nr_newest = -1;
+	for (l->num_free_nonres = 0; l->num_free_nonres < memsize; l->num_free_nonres++) {
+		l->free_nonres[l->num_free_nonres] = nodes - 1 - l->num_free_nonres;
+	}
+
+	// About 1% of memory holds resident HIR pages, as in the paper
+	unsigned hir_max = memsize / 100 ? memsize / 100 : 1;
+	l->lir_max = memsize > hir_max ? memsize - hir_max : 1;
+	l->lir_count = 0;
+	l->nonres = vpmap_create(memsize);
+	sim->alg_data = l;
+}
+
+/* Cleanup any data structures created in lirs_init(). */
+void lirs_cleanup(void)
+{
+	struct lirs_data *l = sim->alg_data;
+	vpmap_destroy(l->nonres);
+	free(l->status);
+	free(l->in_stack);
+	free(l->vpage);
+	free(l->s_prev);
+	free(l->s_next);
+	free(l->q_prev);
+	free(l->q_next);
+	free(l->free_nonres);
+	free(l);
+}
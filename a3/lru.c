@@ -12,87 +12,125 @@
  * Copyright (c) 2019, 2020 Karen Reid
  */
 
+#include <assert.h>
+#include <stdint.h>
 #include "pagetable.h"
 #include "sim.h"
 
+#define NIL UINT32_MAX
 
-list_entry_t *first;
-list_entry_t *last;
-
-list_entry_t *entries;
+/* The LRU list is kept in two arrays of 32-bit links indexed by frame
+ * number, most recently used first. Entry memsize is the list head: the
+ * list is circular through it, so next[head] is the most recently used
+ * frame and prev[head] the least. A frame that is not on the list has
+ * next[frame] == NIL.
+ */
+struct lru_data {
+	uint32_t *next;
+	uint32_t *prev;
+	uint32_t head;
+};
 
-void remove_from_list(list_entry_t *entry){
-	if(entry->frame != -1){
-		if(entry->prev){
-				entry->prev->next = entry->next;
-			} 
-		if(entry->next){
-			entry->next->prev = entry->prev;
-		} else {
-			last = entry->prev;
-		}
-		entry->frame = -1; // set frame in this entry to -1 to indicate not in the list
-	}
+static inline void remove_from_list(struct lru_data *lru, uint32_t frame)
+{
+	lru->next[lru->prev[frame]] = lru->next[frame];
+	lru->prev[lru->next[frame]] = lru->prev[frame];
+	lru->next[frame] = NIL;
 }
+
 /* Page to evict is chosen using the accurate LRU algorithm.
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
  */
 int lru_evict(void)
 {
-	int lru_frame = last->frame;
-	remove_from_list(last);
+	struct lru_data *lru = sim->alg_data;
+	uint32_t lru_frame = lru->prev[lru->head];
+	remove_from_list(lru, lru_frame);
 	return lru_frame;
 }
 
+/* Chooses up to max victims at once: the max least recently used frames,
+ * least recent first. Returns the number chosen.
+ */
+unsigned lru_evict_batch(unsigned *frames, unsigned max)
+{
+	struct lru_data *lru = sim->alg_data;
+	unsigned n = 0;
+
+	while (n < max && lru->prev[lru->head] != lru->head) {
+		uint32_t lru_frame = lru->prev[lru->head];
+		remove_from_list(lru, lru_frame);
+		frames[n++] = lru_frame;
+	}
+	return n;
+}
+
+/* Chooses the least recently used of the frames holding pages of process
+ * pid, for local replacement.
+ */
+int lru_evict_proc(unsigned pid)
+{
+	struct lru_data *lru = sim->alg_data;
+	uint32_t frame = lru->prev[lru->head];
+
+	while (VADDR_PID(sim->coremap[frame].vaddr) != pid) {
+		frame = lru->prev[frame];
+		assert(frame != lru->head);
+	}
+	remove_from_list(lru, frame);
+	return frame;
+}
+
 /* This function is called on each access to a page to update any information
  * needed by the LRU algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
 void lru_ref(pgtbl_entry_t *p)
 {
-	//TODO
-	int frame_referenced = p->frame >> PAGE_SHIFT;
-	struct frame *frame = &coremap[frame_referenced];
-	
-	remove_from_list(frame->entry); // removes if the entry is present
-
-
-	//insert as head of list (most recently referenced)
-	frame->entry->prev = NULL;
-	frame->entry->next = first;
-	frame->entry->frame = frame_referenced;
+	struct lru_data *lru = sim->alg_data;
+	uint32_t frame = p->frame >> PAGE_SHIFT;
+	uint32_t head = lru->head;
 
-	//update first
-	if(first){
-		first->prev = frame->entry;
+	if (lru->next[head] == frame) {
+		return; // already the most recently used
 	}
-	first = frame->entry;
-
-	if(last == NULL) {
-		last = first; // last is initially assigned to the very first element added to the list
+	if (lru->next[frame] != NIL) {
+		remove_from_list(lru, frame);
 	}
 
+	// insert as head of list (most recently referenced)
+	uint32_t first = lru->next[head];
+	lru->next[frame] = first;
+	lru->prev[frame] = head;
+	lru->prev[first] = frame;
+	lru->next[head] = frame;
 }
 
 /* Initialize any data structures needed for this replacement algorithm. */
 void lru_init(void)
 {
-	//TODO
-	first = NULL;
-	last = NULL;
-	entries = malloc(sizeof(list_entry_t) * memsize);
-	for(unsigned i = 0; i < memsize; i++){
-		list_entry_t *entry = entries + i;
-		coremap[i].entry = entry;
-		entry->next = NULL;
-		entry->prev = NULL;
-		entry->frame = -1; //unassigned, not in the list
+	struct lru_data *lru = malloc(sizeof(struct lru_data));
+	unsigned memsize = sim->memsize;
+	if (lru == NULL ||
+	    (lru->next = malloc((memsize + 1) * sizeof(uint32_t))) == NULL ||
+	    (lru->prev = malloc((memsize + 1) * sizeof(uint32_t))) == NULL) {
+		perror("lru_init: malloc");
+		exit(1);
+	}
+	for (unsigned i = 0; i < memsize; i++) {
+		lru->next[i] = NIL; // not in the list
 	}
+	lru->head = memsize;
+	lru->next[memsize] = lru->prev[memsize] = memsize;
+	sim->alg_data = lru;
 }
 
 /* Cleanup any data structures created in lru_init(). */
 void lru_cleanup(void)
 {
-	free(entries);
+	struct lru_data *lru = sim->alg_data;
+	free(lru->next);
+	free(lru->prev);
+	free(lru);
 }
@@ -0,0 +1,162 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Sampled approximate LRU, as in Redis.
+ *
+ * Each frame only records the time (reference count) of its last use, so a
+ * hit is a single store. To evict, lru_samples frames are picked at random
+ * and the one used longest ago is the victim. With an eviction pool
+ * (lru_pool > 0), the best candidates seen so far are kept, oldest first,
+ * across evictions, and the victim is the oldest pool entry that has not
+ * been used since it was sampled. The pool makes the choice much closer to
+ * exact LRU for the same number of samples.
+ */
+#include <stdint.h>
+#include "pagetable.h"
+#include "sim.h"
+
+// Number of frames sampled per eviction and size of the eviction pool
+// (sim -S samples[,pool])
+unsigned lru_samples = 5;
+unsigned lru_pool = 0;
+
+struct pool_entry {
+	unsigned frame;
+	unsigned long last_use;  // frame's last_use when it was sampled
+};
+
+struct lru_sampled_data {
+	unsigned long *last_use;
+	uint64_t seed;           // xorshift state
+
+	struct pool_entry *pool; // Sorted by last_use, oldest first
+	unsigned pool_size;
+};
+
+static unsigned random_frame(struct lru_sampled_data *l)
+{
+	l->seed ^= l->seed << 13;
+	l->seed ^= l->seed >> 7;
+	l->seed ^= l->seed << 17;
+	return l->seed % sim->memsize;
+}
+
+// Adds frame to the pool if it is older than the pool's newest entry or
+// the pool has room.
+static void pool_insert(struct lru_sampled_data *l, unsigned frame)
+{
+	unsigned long t = l->last_use[frame];
+	unsigned i;
+
+	for (i = 0; i < l->pool_size; i++) {
+		if (l->pool[i].frame == frame) {
+			return;
+		}
+	}
+	if (l->pool_size == lru_pool) {
+		if (t >= l->pool[lru_pool - 1].last_use) {
+			return;
+		}
+		l->pool_size--;
+	}
+	for (i = l->pool_size; i > 0 && l->pool[i - 1].last_use > t; i--) {
+		l->pool[i] = l->pool[i - 1];
+	}
+	l->pool[i].frame = frame;
+	l->pool[i].last_use = t;
+	l->pool_size++;
+}
+
+/* Page to evict is chosen by sampling: the least recently used of
+ * lru_samples random frames, or of the eviction pool.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int lru_sampled_evict(void)
+{
+	struct lru_sampled_data *l = sim->alg_data;
+
+	if (lru_pool == 0) {
+		unsigned victim = random_frame(l);
+		for (unsigned k = 1; k < lru_samples; k++) {
+			unsigned f = random_frame(l);
+			if (l->last_use[f] < l->last_use[victim]) {
+				victim = f;
+			}
+		}
+		return victim;
+	}
+
+	for (;;) {
+		for (unsigned k = 0; k < lru_samples; k++) {
+			pool_insert(l, random_frame(l));
+		}
+
+		// Take the oldest entry that is still accurate. An entry whose
+		// frame has been used since it was sampled is dropped.
+		unsigned i;
+		for (i = 0; i < l->pool_size; i++) {
+			if (l->pool[i].last_use == l->last_use[l->pool[i].frame]) {
+				break;
+			}
+		}
+		if (i < l->pool_size) {
+			unsigned victim = l->pool[i].frame;
+			for (unsigned j = i + 1; j < l->pool_size; j++) {
+				l->pool[j - i - 1] = l->pool[j];
+			}
+			l->pool_size -= i + 1;
+			return victim;
+		}
+		l->pool_size = 0;
+	}
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the sampled LRU algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void lru_sampled_ref(pgtbl_entry_t *p)
+{
+	struct lru_sampled_data *l = sim->alg_data;
+	l->last_use[p->frame >> PAGE_SHIFT] = sim->ref_count;
+}
+
+/* Initialize any data structures needed for this replacement algorithm. */
+void lru_sampled_init(void)
+{
+	struct lru_sampled_data *l = malloc(sizeof(struct lru_sampled_data));
+	if (lru_samples == 0) {
+		fprintf(stderr, "Error: lru-sampled needs at least one sample\n");
+		exit(1);
+	}
+	if (l == NULL ||
+	    (l->last_use = calloc(sim->memsize, sizeof(unsigned long))) == NULL ||
+	    (l->pool = malloc((lru_pool + 1) * sizeof(struct pool_entry))) == NULL) {
+		perror("lru_sampled_init: malloc");
+		exit(1);
+	}
+	l->seed = 88172645463325252ULL;
+	l->pool_size = 0;
+	sim->alg_data = l;
+}
+
+/* Cleanup any data structures created in lru_sampled_init(). */
+void lru_sampled_cleanup(void)
+{
+	struct lru_sampled_data *l = sim->alg_data;
+	free(l->last_use);
+	free(l->pool);
+	free(l);
+}
@@ -0,0 +1,165 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* LZ codec.
+ *
+ * The compressed form is a series of sequences. Each has a token byte,
+ * with the number of literals in its high nibble and the match length
+ * minus LZ_MINMATCH in its low nibble, then the literal bytes, then the
+ * match's offset back from the current position (2 bytes, little-endian).
+ * A nibble of 15 is followed by bytes that are added to it, 255 meaning
+ * another byte follows. The last sequence may have literals only, with
+ * nothing after them.
+ *
+ * Matches are found through a hash table of the last position of each
+ * 4-byte string, sized to the input, so compressing a small page is cheap.
+ */
+#include <stdint.h>
+#include <string.h>
+#include "lz.h"
+
+#define LZ_MINMATCH   4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS  14
+
+static size_t put_length(unsigned char *dst, size_t op, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		dst[op++] = 255;
+	}
+	dst[op++] = (unsigned char)len;
+	return op;
+}
+
+static size_t emit(unsigned char *dst, size_t op, const unsigned char *lit,
+                   size_t nlit, size_t offset, size_t len)
+{
+	size_t mlen = len ? len - LZ_MINMATCH : 0;
+	dst[op++] = (unsigned char)(((nlit < 15 ? nlit : 15) << 4) |
+	                            (mlen < 15 ? mlen : 15));
+	if (nlit >= 15) {
+		op = put_length(dst, op, nlit - 15);
+	}
+	memcpy(dst + op, lit, nlit);
+	op += nlit;
+	if (len) {
+		dst[op++] = offset & 0xff;
+		dst[op++] = offset >> 8;
+		if (mlen >= 15) {
+			op = put_length(dst, op, mlen - 15);
+		}
+	}
+	return op;
+}
+
+/* Compresses the n bytes at src into dst, which must have room for
+ * LZ_BOUND(n) bytes. Returns the compressed size.
+ */
+size_t lz_compress(const void *src_, size_t n, void *dst_)
+{
+	const unsigned char *src = src_;
+	unsigned char *dst = dst_;
+	int32_t table[1 << LZ_HASH_BITS];
+	unsigned bits = 4;
+	size_t ip = 0, anchor = 0, op = 0;
+
+	while (bits < LZ_HASH_BITS && ((size_t)1 << bits) < n) {
+		bits++;
+	}
+	for (size_t i = 0; i < (size_t)1 << bits; i++) {
+		table[i] = -1;
+	}
+
+	while (ip + LZ_MINMATCH <= n) {
+		uint32_t v;
+		memcpy(&v, src + ip, sizeof(v));
+		unsigned h = (v * 2654435761U) >> (32 - bits);
+		long ref = table[h];
+		table[h] = ip;
+		if (ref < 0 || ip - ref > LZ_MAX_OFFSET ||
+		    memcmp(src + ref, src + ip, LZ_MINMATCH) != 0) {
+			ip++;
+			continue;
+		}
+		size_t len = LZ_MINMATCH;
+		while (ip + len < n && src[ref + len] == src[ip + len]) {
+			len++;
+		}
+		op = emit(dst, op, src + anchor, ip - anchor, ip - ref, len);
+		ip += len;
+		anchor = ip;
+	}
+	if (anchor < n) {
+		op = emit(dst, op, src + anchor, n - anchor, 0, 0);
+	}
+	return op;
+}
+
+// Reads the extra bytes of a length whose nibble is 15. Returns -1 if
+// they run past the end of the input.
+static long get_length(const unsigned char *src, size_t n, size_t *ip, size_t len)
+{
+	if (len == 15) {
+		unsigned char b;
+		do {
+			if (*ip == n) {
+				return -1;
+			}
+			b = src[(*ip)++];
+			len += b;
+		} while (b == 255);
+	}
+	return len;
+}
+
+/* Decompresses the n bytes at src into dst, which has room for cap bytes.
+ * Returns the decompressed size, or -1 if src is not valid compressed data
+ * or decompresses to more than cap bytes.
+ */
+long lz_decompress(const void *src_, size_t n, void *dst_, size_t cap)
+{
+	const unsigned char *src = src_;
+	unsigned char *dst = dst_;
+	size_t ip = 0, op = 0;
+
+	while (ip < n) {
+		unsigned token = src[ip++];
+		long nlit = get_length(src, n, &ip, token >> 4);
+		if (nlit < 0 || (size_t)nlit > n - ip || (size_t)nlit > cap - op) {
+			return -1;
+		}
+		memcpy(dst + op, src + ip, nlit);
+		ip += nlit;
+		op += nlit;
+		if (ip == n) {
+			break;
+		}
+		if (n - ip < 2) {
+			return -1;
+		}
+		size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+		ip += 2;
+		long len = get_length(src, n, &ip, token & 0xf);
+		if (len < 0 || offset == 0 || offset > op ||
+		    (size_t)len + LZ_MINMATCH > cap - op) {
+			return -1;
+		}
+		len += LZ_MINMATCH;
+		// Byte by byte, as the match may overlap its own output
+		for (long i = 0; i < len; i++, op++) {
+			dst[op] = dst[op - offset];
+		}
+	}
+	return op;
+}
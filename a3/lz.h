@@ -0,0 +1,16 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include <stddef.h>
+
+/* A small LZ77 codec in the style of LZ4, for swapped-out pages (see
+ * zswap.c) and trace blocks (see trace.h).
+ */
+
+// Largest compressed size of n bytes
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+size_t lz_compress(const void *src, size_t n, void *dst);
+long lz_decompress(const void *src, size_t n, void *dst, size_t cap);
+
+#endif /* __LZ_H__ */
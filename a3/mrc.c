@@ -0,0 +1,141 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Miss-ratio curve for LRU over every memory size in one pass of the trace.
+ *
+ * LRU is a stack algorithm: a reference hits in a memory of m frames exactly
+ * when its stack (reuse) distance, the number of distinct pages referenced
+ * since the previous reference to the same page, is at most m. We find each
+ * distance with a Fenwick tree over reference times that holds a mark at the
+ * time of the most recent reference to every page, so counting the marks
+ * after a page's previous reference gives its distance in O(log n).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "trace.h"
+#include "vpmap.h"
+
+// Fenwick tree over times 1..fen_size (fen_size is a power of two)
+static int *fen;
+static unsigned long fen_size;
+
+static void fen_add(unsigned long i, int delta)
+{
+	for (; i <= fen_size; i += i & -i) {
+		fen[i] += delta;
+	}
+}
+
+static long fen_sum(unsigned long i)
+{
+	long sum = 0;
+	for (; i > 0; i -= i & -i) {
+		sum += fen[i];
+	}
+	return sum;
+}
+
+/* Doubles the range of the tree. The new nodes above the old size cover only
+ * new (unmarked) times, except the new root, which covers everything.
+ */
+static void fen_grow(void)
+{
+	unsigned long n = fen_size;
+	long total = fen_sum(n);
+
+	if ((fen = realloc(fen, (2 * n + 1) * sizeof(int))) == NULL) {
+		perror("mrc: realloc");
+		exit(1);
+	}
+	memset(fen + n + 1, 0, n * sizeof(int));
+	fen_size = 2 * n;
+	fen[fen_size] = total;
+}
+
+/* Replays the trace once and prints the LRU hit and miss counts for every
+ * memory size from 1 to maxmem frames. If maxmem is 0, the curve is printed
+ * up to the number of distinct pages, beyond which it no longer changes.
+ */
+void mrc_run(struct trace *t, unsigned maxmem)
+{
+	struct vpmap *last_ref = vpmap_create(0);
+	unsigned long *hist = NULL;  // hist[d] = number of references at distance d
+	unsigned long hist_size = 0;
+	unsigned long refs = 0, distinct = 0;
+
+	fen_size = t->recs && t->nrecs ? t->nrecs : 1UL << 20;
+	fen_size = 1UL << (64 - __builtin_clzl((fen_size - 1) | 1));
+	if ((fen = calloc(fen_size + 1, sizeof(int))) == NULL) {
+		perror("mrc: calloc");
+		exit(1);
+	}
+
+	char type;
+	addr_t vaddr;
+	while (trace_next(t, &type, &vaddr)) {
+		unsigned long now = ++refs;
+		addr_t vpage = vaddr >> PAGE_SHIFT;
+		long prev;
+
+		if (now > fen_size) {
+			fen_grow();
+		}
+
+		if (vpmap_get(last_ref, vpage, &prev)) {
+			// Pages referenced since prev, plus this page itself
+			unsigned long dist = distinct - fen_sum(prev) + 1;
+			if (dist >= hist_size) {
+				unsigned long n = hist_size ? hist_size : 1024;
+				while (n <= dist) {
+					n *= 2;
+				}
+				if ((hist = realloc(hist, n * sizeof(unsigned long))) == NULL) {
+					perror("mrc: realloc");
+					exit(1);
+				}
+				memset(hist + hist_size, 0, (n - hist_size) * sizeof(unsigned long));
+				hist_size = n;
+			}
+			hist[dist]++;
+			fen_add(prev, -1);
+		} else {
+			distinct++;
+		}
+		fen_add(now, 1);
+		vpmap_put(last_ref, vpage, now);
+	}
+
+	if (maxmem == 0) {
+		maxmem = distinct;
+	}
+
+	printf("Total references : %lu\n", refs);
+	printf("Distinct pages: %lu\n", distinct);
+	printf("Cold misses: %lu\n\n", distinct);
+	printf("%10s %12s %12s %9s\n", "Memsize", "Hit count", "Miss count", "Hit rate");
+	unsigned long hits = 0;
+	for (unsigned long m = 1; m <= maxmem; m++) {
+		if (m < hist_size) {
+			hits += hist[m];
+		}
+		printf("%10lu %12lu %12lu %9.4f\n", m, hits, refs - hits,
+		       refs ? (double)hits / refs * 100 : 0.0);
+	}
+
+	free(hist);
+	free(fen);
+	vpmap_destroy(last_ref);
+}
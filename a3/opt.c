@@ -0,0 +1,221 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+#include <stdint.h>
+#include "pagetable.h"
+#include "sim.h"
+#include "trace.h"
+#include "vpmap.h"
+
+#define NEVER UINT32_MAX
+
+struct opt_data {
+	// next_use[i] is the index of the next reference to the page referenced
+	// at index i of the trace, or NEVER if it is not referenced again.
+	uint32_t *next_use;
+	unsigned long num_refs;
+
+	// The index of the next reference to each page, from the last
+	// reference made, for pages brought in without a reference (see
+	// opt_insert()).
+	struct vpmap *page_next;
+
+	// Max-heap of the resident frames, ordered by the next use of their
+	// page. heap_pos[frame] is the frame's index in heap, or -1 if it is
+	// not in it.
+	int *heap;
+	int *heap_pos;
+	uint32_t *frame_next;
+	unsigned heap_size;
+};
+
+static void heap_swap(struct opt_data *o, unsigned i, unsigned j)
+{
+	int fi = o->heap[i], fj = o->heap[j];
+	o->heap[i] = fj;
+	o->heap_pos[fj] = i;
+	o->heap[j] = fi;
+	o->heap_pos[fi] = j;
+}
+
+static void heap_up(struct opt_data *o, unsigned i)
+{
+	while (i > 0) {
+		unsigned parent = (i - 1) / 2;
+		if (o->frame_next[o->heap[parent]] >= o->frame_next[o->heap[i]]) {
+			break;
+		}
+		heap_swap(o, i, parent);
+		i = parent;
+	}
+}
+
+static void heap_down(struct opt_data *o, unsigned i)
+{
+	uint32_t *key = o->frame_next;
+	for (;;) {
+		unsigned l = 2 * i + 1, r = l + 1, max = i;
+		if (l < o->heap_size && key[o->heap[l]] > key[o->heap[max]]) {
+			max = l;
+		}
+		if (r < o->heap_size && key[o->heap[r]] > key[o->heap[max]]) {
+			max = r;
+		}
+		if (max == i) {
+			break;
+		}
+		heap_swap(o, i, max);
+		i = max;
+	}
+}
+
+/* Page to evict is chosen using the optimal (Belady) algorithm: the page
+ * whose next use is farthest in the future.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int opt_evict(void)
+{
+	// The victim stays in the heap; the reference that follows the
+	// eviction gives its frame a new key in opt_ref() or opt_insert().
+	struct opt_data *o = sim->alg_data;
+	return o->heap[0];
+}
+
+/* Gives frame the key next, the index of the next use of its page. */
+static void set_next(struct opt_data *o, int frame, uint32_t next)
+{
+	uint32_t old = o->frame_next[frame];
+
+	o->frame_next[frame] = next;
+	if (o->heap_pos[frame] == -1) {
+		o->heap[o->heap_size] = frame;
+		o->heap_pos[frame] = o->heap_size++;
+		heap_up(o, o->heap_pos[frame]);
+	} else if (next > old) {
+		heap_up(o, o->heap_pos[frame]);
+	} else {
+		heap_down(o, o->heap_pos[frame]);
+	}
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the OPT algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void opt_ref(pgtbl_entry_t *p)
+{
+	struct opt_data *o = sim->alg_data;
+	int frame = p->frame >> PAGE_SHIFT;
+	unsigned long idx = sim->ref_count - 1;
+	uint32_t next = idx < o->num_refs ? o->next_use[idx] : NEVER;
+
+	vpmap_put(o->page_next, sim->coremap[frame].vaddr >> PAGE_SHIFT, next);
+	set_next(o, frame, next);
+}
+
+/* Called for a page brought in without a reference. Its key is the next
+ * use of the page from the last reference.
+ */
+void opt_insert(pgtbl_entry_t *p)
+{
+	struct opt_data *o = sim->alg_data;
+	int frame = p->frame >> PAGE_SHIFT;
+	long next;
+
+	if (!vpmap_get(o->page_next, sim->coremap[frame].vaddr >> PAGE_SHIFT, &next)) {
+		next = NEVER;
+	}
+	set_next(o, frame, next);
+}
+
+/* Initialize any data structures needed for this replacement algorithm.
+ * Reads the whole trace once to find, for every reference, the index of
+ * the next reference to the same page.
+ */
+void opt_init(void)
+{
+	struct opt_data *o = calloc(1, sizeof(struct opt_data));
+	struct trace *t = sim->trace;
+	if (o == NULL) {
+		perror("opt_init: calloc");
+		exit(1);
+	}
+
+	unsigned long cap = (t->recs && t->nrecs) ? t->nrecs : 1UL << 20;
+	uint32_t *next_use = malloc(cap * sizeof(uint32_t));
+	struct vpmap *last_use = vpmap_create(sim->memsize);
+	struct vpmap *first_use = vpmap_create(sim->memsize);
+	if (next_use == NULL) {
+		perror("opt_init: malloc");
+		exit(1);
+	}
+
+	char type;
+	addr_t vaddr;
+	unsigned long num_refs = 0;
+	while (trace_next(t, &type, &vaddr)) {
+		if (num_refs == NEVER) {
+			fprintf(stderr, "opt_init: trace is too long\n");
+			exit(1);
+		}
+		if (num_refs == cap) {
+			cap *= 2;
+			if ((next_use = realloc(next_use, cap * sizeof(uint32_t))) == NULL) {
+				perror("opt_init: realloc");
+				exit(1);
+			}
+		}
+
+		long prev;
+		addr_t vpage = vaddr >> PAGE_SHIFT;
+		if (vpmap_get(last_use, vpage, &prev)) {
+			next_use[prev] = num_refs;
+		} else {
+			vpmap_put(first_use, vpage, num_refs);
+		}
+		vpmap_put(last_use, vpage, num_refs);
+		next_use[num_refs++] = NEVER;
+	}
+	vpmap_destroy(last_use);
+	trace_rewind(t);
+	o->next_use = next_use;
+	o->num_refs = num_refs;
+	o->page_next = first_use;
+
+	unsigned memsize = sim->memsize;
+	o->heap = malloc(memsize * sizeof(int));
+	o->heap_pos = malloc(memsize * sizeof(int));
+	o->frame_next = malloc(memsize * sizeof(uint32_t));
+	if (o->heap == NULL || o->heap_pos == NULL || o->frame_next == NULL) {
+		perror("opt_init: malloc");
+		exit(1);
+	}
+	for (unsigned i = 0; i < memsize; i++) {
+		o->heap_pos[i] = -1;
+	}
+	sim->alg_data = o;
+}
+
+/* Cleanup any data structures created in opt_init(). */
+void opt_cleanup(void)
+{
+	struct opt_data *o = sim->alg_data;
+	free(o->next_use);
+	vpmap_destroy(o->page_next);
+	free(o->heap);
+	free(o->heap_pos);
+	free(o->frame_next);
+	free(o);
+}
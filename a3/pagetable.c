@@ -13,113 +13,409 @@
  */
 #include <assert.h>
 #include <string.h> 
+#include <sched.h>
 #include "sim.h"
 #include "pagetable.h"
 
-// The top-level page table (also known as the 'page directory')
-pgdir_entry_t pgdir[PTRS_PER_PGDIR]; 
+// The top-level page table (also known as the 'page directory') of each
+// process and the counters for various events live in the current
+// simulation (sim->procs, sim->hit_count, ...). Your code must increment the counters when the
+// related events occur.
 
-// Counters for various events.
-// Your code must increment these when the related events occur.
-int hit_count = 0;
-int miss_count = 0;
-int ref_count = 0;
-int evict_clean_count = 0;
-int evict_dirty_count = 0;
+// Frames freed at a time when memory is full, if the replacement algorithm
+// can choose several victims at once (sim -B)
+unsigned reclaim_batch = 1;
+
+// Global (0) or local (1) replacement (sim -P)
+int local_replacement = 0;
 
 /*
- * Allocates a frame to be used for the virtual page represented by p.
- * If all frames are in use, calls the replacement algorithm's evict_fcn to
- * select a victim frame.  Writes victim to swap if needed, and updates 
- * pagetable entry for victim to indicate that virtual page is no longer in
- * (simulated) physical memory.
+ * Removes the page in frame from (simulated) physical memory, now that
+ * there is a copy of it at swap_off, and frees the frame.
+ */
+static void unmap_victim(unsigned frame, int swap_off)
+{
+	struct frame *victim_frame = &sim->coremap[frame];
+	struct proc *owner = &sim->procs[VADDR_PID(victim_frame->vaddr)];
+
+	owner->resident--;
+	owner->evict_count++;
+	if (VADDR_PID(victim_frame->vaddr) != VADDR_PID(sim->fault_vaddr)) {
+		owner->stolen_count++;
+	}
+
+	// The victim's translation is no longer valid
+	if (sim->tlb) {
+		tlb_invalidate(victim_frame->vaddr >> PAGE_SHIFT);
+	}
+
+	// The pte now records where the page is in swap instead of
+	// which frame it was in
+	uint64_t flags = victim_frame->pte->frame & ~PAGE_MASK;
+	victim_frame->pte->frame = ((uint64_t)(swap_off / SIMPAGESIZE) << PAGE_SHIFT) |
+	                           (flags & ~PG_VALID & ~PG_DIRTY) | PG_ONSWAP;
+	victim_frame->in_use = 0;
+	if (sim->huge) {
+		huge_frame_freed(frame);
+	}
+}
+
+/*
+ * Under local replacement, returns the process that gives up a frame for
+ * the page being brought in: the faulting process itself if it holds at
+ * least its share of memory (memsize divided evenly among the processes
+ * seen so far), otherwise the process holding the most frames, which is
+ * the one furthest over its share.
+ */
+static unsigned local_victim_pid(void)
+{
+	unsigned pid = VADDR_PID(sim->fault_vaddr);
+	unsigned share = sim->memsize / sim->num_procs;
+
+	if (sim->procs[pid].resident >= share && sim->procs[pid].resident > 0) {
+		return pid;
+	}
+	for (unsigned i = 0; i < sim->procs_size; i++) {
+		if (sim->procs[i].resident > sim->procs[pid].resident) {
+			pid = i;
+		}
+	}
+	return pid;
+}
+
+/*
+ * Called when all frames are in use. Under local replacement, asks the
+ * replacement algorithm for a victim among the pages of the process chosen
+ * by local_victim_pid(). Otherwise asks it for up to reclaim_batch victims
+ * at once, if it has an evict_batch function, or for one with its evict
+ * function. Clean victims are simply
+ * dropped. Dirty victims are written to swap together: to consecutive
+ * slots with one vectored write if there is a free run of slots for them,
+ * otherwise one at a time. The victims go on the free frame stack, the
+ * first one chosen on top.
  *
- * Counters for evictions should be updated appropriately in this function.
+ * A victim in a huge page demotes it first (see huge_evicting()).
  */
-static int allocate_frame(pgtbl_entry_t *p)
+static void reclaim_frames(void)
 {
-	int frame = -1;
-	for (unsigned i = 0; i < memsize; i++) {
-		if (!coremap[i].in_use) {
-			frame = i;
-			break;
+	struct frame *coremap = sim->coremap;
+	unsigned *victims = sim->reclaim_victims;
+	unsigned *dirty = sim->reclaim_dirty;
+	unsigned batch = reclaim_batch < sim->memsize ? reclaim_batch : sim->memsize;
+	unsigned n = 1, ndirty = 0;
+
+	if (local_replacement) {
+		unsigned pid = local_victim_pid();
+		victims[0] = sim->alg.evict_proc(pid);
+		assert(VADDR_PID(coremap[victims[0]].vaddr) == pid);
+	} else if (batch > 1 && sim->alg.evict_batch != NULL) {
+		n = sim->alg.evict_batch(victims, batch);
+		assert(n >= 1 && n <= batch);
+	} else {
+		victims[0] = sim->alg.evict();
+	}
+	sim->reclaim_count++;
+
+	if (sim->huge) {
+		for (unsigned i = 0; i < n; i++) {
+			huge_evicting(victims[i]);
 		}
 	}
 
-	if (frame == -1) { // Didn't find a free page.
-		// Call replacement algorithm's evict function to select victim
-		frame = evict_fcn();
+	for (unsigned i = 0; i < n; i++) {
+		struct frame *victim_frame = &coremap[victims[i]];
+		assert(victim_frame->in_use);
+
+		// With several CPUs, the page must be unmapped, and any CPU
+		// using it without the lock done with it, before it is written
+		if (sim->cpus) {
+			__atomic_fetch_and(&victim_frame->pte->frame, ~(uint64_t)PG_VALID,
+			                   __ATOMIC_SEQ_CST);
+			while (__atomic_load_n(&victim_frame->pins, __ATOMIC_SEQ_CST) != 0) {
+				sched_yield();
+			}
+		}
 
-		// All frames were in use, so victim frame must hold some page
-		// Write victim page to swap, if needed, and update pagetable
-		// IMPLEMENTATION NEEDED
-		struct frame victim_frame = coremap[frame];
+		if (victim_frame->prefetched) {
+			sim->prefetch_wasted_count++;
+		}
 
-		if(!(victim_frame.pte->frame & PG_DIRTY)){
-			//page is clean, unmodifies
-			evict_clean_count++;
+		if (!(victim_frame->pte->frame & PG_DIRTY)) {
+			// Page is clean, the copy in swap is up to date
+			assert(victim_frame->swap_off != INVALID_SWAP);
+			sim->evict_clean_count++;
+			if (victim_frame->cleaned) {
+				sim->clean_saved_count++;
+			}
+			unmap_victim(victims[i], victim_frame->swap_off);
 		} else {
-			//page dirty, modified
-			int new_swap_off = swap_pageout(frame, victim_frame.pte->swap_off);
-			victim_frame.pte->swap_off = new_swap_off;
-			evict_dirty_count++;
-
+			sim->evict_dirty_count++;
+			sim->num_dirty--;
+			dirty[ndirty++] = victims[i];
 		}
+	}
 
-		victim_frame.pte->frame = (victim_frame.pte->frame & ~PG_VALID & ~PG_DIRTY) | PG_ONSWAP;
+	int cluster_off = INVALID_SWAP;
+	if (ndirty > 1) {
+		for (unsigned i = 0; i < ndirty; i++) {
+			if (coremap[dirty[i]].swap_off != INVALID_SWAP) {
+				swap_free(coremap[dirty[i]].swap_off);
+				coremap[dirty[i]].swap_off = INVALID_SWAP;
+			}
+		}
+		cluster_off = swap_pageout_cluster(dirty, ndirty);
+	}
+	for (unsigned i = 0; i < ndirty; i++) {
+		int swap_off;
+		if (cluster_off != INVALID_SWAP) {
+			swap_off = cluster_off + i * SIMPAGESIZE;
+		} else {
+			swap_off = swap_pageout(dirty[i], coremap[dirty[i]].swap_off);
+			assert(swap_off != INVALID_SWAP);
+		}
+		unmap_victim(dirty[i], swap_off);
+	}
 
+	for (unsigned i = n; i-- > 0; ) {
+		sim->free_frames[sim->num_free++] = victims[i];
+	}
+}
 
+/*
+ * Allocates a frame to be used for the virtual page represented by p.
+ * If all frames are in use, calls reclaim_frames() to evict one or more
+ * pages first (see above).
+ *
+ * Counters for evictions should be updated appropriately in this function.
+ */
+static int allocate_frame(pgtbl_entry_t *p)
+{
+	struct frame *coremap = sim->coremap;
+
+	// Frames that are not in use are kept on a stack, so there is no need
+	// to scan the coremap for one. The lowest-numbered frame is on top,
+	// so frames are handed out in order.
+	// With huge pages, a page of a region that has a reservation goes
+	// in its own frame of the reservation instead (see huge.c), and
+	// reservations are given up before any page is evicted.
+	int frame = sim->huge ? huge_alloc_frame(sim->fault_vaddr) : -1;
+	if (frame < 0) {
+		if (sim->num_free == 0 &&
+		    !(sim->huge && huge_break_reservation())) {
+			reclaim_frames();
+		}
+		frame = sim->free_frames[--sim->num_free];
+	}
+	assert(!coremap[frame].in_use);
+	if (sim->huge) {
+		huge_frame_used(frame);
 	}
 
 	// Record information for virtual page that will now be stored in frame
+	sim->procs[VADDR_PID(sim->fault_vaddr)].resident++;
 	coremap[frame].in_use = 1;
 	coremap[frame].pte = p;
+	coremap[frame].prefetched = 0;
+	coremap[frame].cleaned = 0;
 
 	return frame;
 }
 
 /*
- * Initializes the top-level pagetable.
- * This function is called once at the start of the simulation.
- * For the simulation, there is a single "process" whose reference trace is 
- * being simulated, so there is just one top-level page table (page directory).
- * To keep things simple, we use a global array of 'page directory entries'.
- *
- * In a real OS, each process would have its own page directory, which would
- * need to be allocated and initialized as part of process creation.
+ * Writes the dirty page in frame to swap ahead of its eviction, so that
+ * evicting it later needs no write. The page stays in memory, now clean.
  */
-void init_pagetable(void)
+void clean_frame(int frame)
+{
+	struct frame *f = &sim->coremap[frame];
+
+	assert(f->in_use && (f->pte->frame & PG_DIRTY));
+	f->swap_off = swap_pageout(frame, f->swap_off);
+	assert(f->swap_off != INVALID_SWAP);
+	f->pte->frame &= ~PG_DIRTY;
+	f->cleaned = 1;
+	sim->num_dirty--;
+	sim->clean_write_count++;
+}
+
+/*
+ * Writes the dirty pages in frames to swap ahead of their eviction, like
+ * clean_frame(), to consecutive slots with one vectored write if there is
+ * a free run of slots for them.
+ */
+void clean_frames(const unsigned *frames, unsigned n)
 {
-	// Set all entries in top-level pagetable to 0, which ensures valid
-	// bits are all 0 initially.
-	for (int i = 0; i < PTRS_PER_PGDIR; i++) {
-		pgdir[i].pde = 0;
+	struct frame *coremap = sim->coremap;
+	int cluster_off = INVALID_SWAP;
+
+	if (n > 1) {
+		for (unsigned i = 0; i < n; i++) {
+			if (coremap[frames[i]].swap_off != INVALID_SWAP) {
+				swap_free(coremap[frames[i]].swap_off);
+				coremap[frames[i]].swap_off = INVALID_SWAP;
+			}
+		}
+		cluster_off = swap_pageout_cluster(frames, n);
+	}
+	if (cluster_off == INVALID_SWAP) {
+		for (unsigned i = 0; i < n; i++) {
+			clean_frame(frames[i]);
+		}
+		return;
+	}
+	for (unsigned i = 0; i < n; i++) {
+		struct frame *f = &coremap[frames[i]];
+		assert(f->in_use && (f->pte->frame & PG_DIRTY));
+		f->swap_off = cluster_off + i * SIMPAGESIZE;
+		f->pte->frame &= ~PG_DIRTY;
+		f->cleaned = 1;
+		sim->num_dirty--;
+		sim->clean_write_count++;
 	}
 }
 
-// For simulation, we get second-level pagetables from ordinary memory
-static pgdir_entry_t init_second_level(void)
+unsigned pt_levels = PT_DEFAULT_LEVELS;
+
+// For simulation, we get pagetables at every level from ordinary memory.
+// A table has 2^bits entries; page directory and page table entries are
+// the same size, and all zeroes means invalid for both.
+static void *alloc_table(unsigned bits)
 {
-	pgtbl_entry_t *pgtbl;
+	void *table;
+	size_t size = ((size_t)1 << bits) * sizeof(pgtbl_entry_t);
+
 	// Allocating aligned memory ensures the low bits in the pointer must
 	// be zero, so we can use them to store our status bits, like PG_VALID
-	if (posix_memalign((void **)&pgtbl, PAGE_SIZE,
-	                   PTRS_PER_PGTBL * sizeof(pgtbl_entry_t)) != 0) {
+	if (posix_memalign(&table, PAGE_SIZE, size) != 0) {
 		perror("Failed to allocate aligned memory for page table");
 		exit(1);
 	}
+	memset(table, 0, size);
+	return table;
+}
 
-	// Initialize all entries in second-level pagetable
-	for (int i = 0; i < PTRS_PER_PGTBL; i++) {
-		pgtbl[i].frame = 0; // sets all bits, including valid, to zero
-		pgtbl[i].swap_off = INVALID_SWAP;
+/*
+ * Makes room in the process table for PIDs up to max_pid. With several
+ * CPUs, this is done for every PID in the trace before the replay starts,
+ * so that the table never moves while a CPU is reading it without the
+ * memory lock.
+ */
+void reserve_procs(unsigned max_pid)
+{
+	if (max_pid < sim->procs_size) {
+		return;
+	}
+	unsigned size = sim->procs_size ? sim->procs_size : 1;
+	while (size <= max_pid) {
+		size *= 2;
+	}
+	struct proc *procs = realloc(sim->procs, size * sizeof(struct proc));
+	if (procs == NULL) {
+		perror("Failed to allocate process table");
+		exit(1);
+	}
+	memset(procs + sim->procs_size, 0,
+	       (size - sim->procs_size) * sizeof(struct proc));
+	sim->procs = procs;
+	sim->procs_size = size;
+}
+
+/*
+ * Returns process pid, creating it with an empty top-level page table if
+ * create is set and this is the first reference seen from it. Returns NULL
+ * if the process has not been seen and create is not set.
+ *
+ * In a real OS, the page directory would be allocated and initialized as
+ * part of process creation.
+ */
+static struct proc *find_proc(unsigned pid, int create)
+{
+	if (pid >= sim->procs_size) {
+		if (!create) {
+			return NULL;
+		}
+		reserve_procs(pid);
+	}
+
+	struct proc *proc = &sim->procs[pid];
+	if (proc->pgdir == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		// Set all entries in top-level pagetable to 0, which ensures
+		// valid bits are all 0 initially.
+		__atomic_store_n(&proc->pgdir, alloc_table(sim->pt_bits[0]),
+		                 __ATOMIC_RELEASE);
+		sim->num_procs++;
+	}
+	return proc;
+}
+
+/*
+ * Initializes the page table layout and the free frame stack.
+ * This function is called once at the start of the simulation.
+ * The page directory of each process in the trace is created the first
+ * time the process is seen (see find_proc()).
+ */
+void init_pagetable(void)
+{
+	// Split the index bits over pt_levels levels, from the bottom up,
+	// giving any leftover bits to the top level.
+	unsigned index_bits = VADDR_BITS - PAGE_SHIFT;
+	unsigned per_level = (index_bits + pt_levels - 1) / pt_levels;
+	unsigned shift = PAGE_SHIFT;
+	for (int level = pt_levels - 1; level >= 0; level--) {
+		sim->pt_bits[level] = level == 0 ? index_bits : per_level;
+		sim->pt_shift[level] = shift;
+		shift += sim->pt_bits[level];
+		index_bits -= sim->pt_bits[level];
+	}
+
+	// Every frame starts out free
+	unsigned memsize = sim->memsize;
+	if ((sim->free_frames = malloc(memsize * sizeof(unsigned))) == NULL) {
+		perror("Failed to allocate free frame stack");
+		exit(1);
+	}
+	for (sim->num_free = 0; sim->num_free < memsize; sim->num_free++) {
+		sim->free_frames[sim->num_free] = memsize - 1 - sim->num_free;
 	}
+	unsigned batch = reclaim_batch < memsize ? reclaim_batch : memsize;
+	if ((sim->reclaim_victims = malloc(batch * sizeof(unsigned))) == NULL ||
+	    (sim->reclaim_dirty = malloc(batch * sizeof(unsigned))) == NULL) {
+		perror("Failed to allocate reclaim list");
+		exit(1);
+	}
+}
 
-	pgdir_entry_t new_entry;
-	// Mark the new page directory entry as valid
-	new_entry.pde = (uintptr_t)pgtbl | PG_VALID;
+static void destroy_table(pgdir_entry_t *table, unsigned level)
+{
+	if (level < pt_levels - 1) {
+		for (size_t i = 0; i < (size_t)1 << sim->pt_bits[level]; i++) {
+			if (table[i].pde & PG_VALID) {
+				destroy_table((pgdir_entry_t *)(table[i].pde & PAGE_MASK),
+				              level + 1);
+			}
+		}
+	}
+	free(table);
+}
 
-	return new_entry;
+/*
+ * Frees the page directory and every lower-level pagetable of every process.
+ * This function is called once at the end of the simulation.
+ */
+void destroy_pagetable(void)
+{
+	for (unsigned pid = 0; pid < sim->procs_size; pid++) {
+		if (sim->procs[pid].pgdir != NULL) {
+			destroy_table(sim->procs[pid].pgdir, 0);
+		}
+	}
+	free(sim->procs);
+	free(sim->free_frames);
+	free(sim->reclaim_victims);
+	free(sim->reclaim_dirty);
 }
 
 /* 
@@ -135,7 +431,7 @@ static pgdir_entry_t init_second_level(void)
 static void init_frame(int frame, addr_t vaddr)
 {
 	// Calculate pointer to start of frame in (simulated) physical memory
-	char *mem_ptr = &physmem[frame * SIMPAGESIZE];
+	char *mem_ptr = &sim->physmem[frame * SIMPAGESIZE];
 	// Calculate pointer to location in page where we keep the vaddr
 	addr_t *vaddr_ptr = (addr_t *)(mem_ptr + sizeof(int));
 
@@ -143,6 +439,205 @@ static void init_frame(int frame, addr_t vaddr)
 	*vaddr_ptr = vaddr;              // record the vaddr for error checking
 }
 
+/*
+ * Returns the page table entry for vaddr, in the page tables of the process
+ * whose PID is in vaddr. Missing page tables (and processes) are allocated
+ * if alloc is set; otherwise NULL is returned if there is no page table
+ * for vaddr yet. If huge is not NULL, it is set if the walk stopped at a
+ * directory entry mapping a huge page (see huge.c).
+ */
+static pgtbl_entry_t *walk_pagetable(addr_t vaddr, int alloc, int *huge)
+{
+	struct proc *proc = find_proc(VADDR_PID(vaddr), alloc);
+	if (proc == NULL) {
+		return NULL;
+	}
+	pgdir_entry_t *table = __atomic_load_n(&proc->pgdir, __ATOMIC_ACQUIRE);
+	unsigned last = pt_levels - 1;
+
+	// Walk down the page directories, allocating any missing tables.
+	// A new table is published only once it is initialized, for CPUs
+	// walking without the memory lock (see pin_frame()).
+	for (unsigned level = 0; level < last; level++) {
+		addr_t idx = (vaddr >> sim->pt_shift[level]) &
+		             (((addr_t)1 << sim->pt_bits[level]) - 1);
+		uintptr_t pde = __atomic_load_n(&table[idx].pde, __ATOMIC_ACQUIRE);
+		if (pde == 0) {
+			if (!alloc) {
+				return NULL;
+			}
+			pde = (uintptr_t)alloc_table(sim->pt_bits[level + 1]) | PG_VALID;
+			__atomic_store_n(&table[idx].pde, pde, __ATOMIC_RELEASE);
+		}
+		table = (pgdir_entry_t *)(pde & PAGE_MASK);
+
+		// A huge page's frame is found from its directory entry
+		// alone. The leaf table stays in place under it (as Linux
+		// deposits one for splitting a huge page), and its entries
+		// still hold each base page's flags for the replacement
+		// algorithm, but reading them is not part of the walk.
+		if (huge && level == last - 1) {
+			*huge = (pde & PG_HUGE) != 0;
+		}
+	}
+
+	// Use vaddr to get index into last-level page table
+	pgtbl_entry_t *page_table = (pgtbl_entry_t *)table;
+	addr_t page_table_idx = (vaddr >> PAGE_SHIFT) &
+	                        (((addr_t)1 << sim->pt_bits[last]) - 1);
+	return &page_table[page_table_idx];
+}
+
+/*
+ * Returns the directory entry that points to the leaf page table for
+ * vaddr, which must already exist. Setting PG_HUGE in it maps the whole
+ * span of the leaf table as one huge page.
+ */
+pgdir_entry_t *leaf_pde(addr_t vaddr)
+{
+	pgdir_entry_t *table = sim->procs[VADDR_PID(vaddr)].pgdir;
+	pgdir_entry_t *pde = NULL;
+
+	for (unsigned level = 0; level < pt_levels - 1; level++) {
+		addr_t idx = (vaddr >> sim->pt_shift[level]) &
+		             (((addr_t)1 << sim->pt_bits[level]) - 1);
+		pde = &table[idx];
+		assert(pde->pde & PG_VALID);
+		table = (pgdir_entry_t *)(pde->pde & PAGE_MASK);
+	}
+	return pde;
+}
+
+/*
+ * Fills frame, just allocated for the page at vaddr, from swap if the page
+ * is there or with zeroes if this is its first use, and points p at it.
+ * A page used for the first time starts out dirty. p is not marked valid.
+ */
+static void page_in(int frame, pgtbl_entry_t *p, addr_t vaddr)
+{
+	if(p->frame & PG_ONSWAP){
+		int swap_off = (p->frame >> PAGE_SHIFT) * SIMPAGESIZE;
+		int error = swap_pagein(frame, swap_off);
+		assert(error == 0);
+
+		sim->coremap[frame].swap_off = swap_off;
+		p->frame = (uint64_t)frame << PAGE_SHIFT;
+		p->frame = (p->frame & ~PG_DIRTY) | PG_ONSWAP;
+	} else {
+		init_frame(frame, vaddr);
+		sim->coremap[frame].swap_off = INVALID_SWAP;
+		p->frame = (uint64_t)frame << PAGE_SHIFT;
+		p->frame = p->frame | PG_DIRTY;
+		sim->num_dirty++;
+	}
+	sim->coremap[frame].vaddr = vaddr;
+}
+
+/*
+ * Tells the replacement algorithm about a page brought in without a
+ * reference.
+ */
+static void insert_page(pgtbl_entry_t *p)
+{
+	if (sim->alg.insert) {
+		sim->alg.insert(p);
+	} else {
+		sim->alg.ref(p);
+	}
+}
+
+/*
+ * Brings the page at vaddr, whose pte is p, into memory without a
+ * reference, to complete a huge page before it is promoted. As with
+ * readahead, the replacement algorithm takes the page in unreferenced.
+ */
+void fill_page(pgtbl_entry_t *p, addr_t vaddr)
+{
+	assert(!(p->frame & PG_VALID));
+	sim->fault_vaddr = vaddr;
+	int frame = allocate_frame(p);
+	page_in(frame, p, vaddr);
+	p->frame |= PG_VALID;
+	insert_page(p);
+}
+
+/*
+ * Reads the page at vaddr in from swap before it is used, for readahead.
+ * The page is not referenced, so it stays clean and unreferenced, and the
+ * replacement algorithm takes it in without marking it referenced.
+ * Returns 0 if the page was read in, or -1 if it is already in memory or
+ * is not on swap.
+ */
+int prefetch_page(addr_t vaddr)
+{
+	pgtbl_entry_t *p = walk_pagetable(vaddr, 0, NULL);
+	if (p == NULL || (p->frame & PG_VALID) || !(p->frame & PG_ONSWAP)) {
+		return -1;
+	}
+
+	if (sim->num_free == 0) {
+		sim->prefetch_evict_count++;
+	}
+	sim->fault_vaddr = vaddr;
+	int frame = allocate_frame(p);
+	int swap_off = (p->frame >> PAGE_SHIFT) * SIMPAGESIZE;
+	int error = swap_pagein(frame, swap_off);
+	assert(error == 0);
+
+	sim->coremap[frame].swap_off = swap_off;
+	sim->coremap[frame].vaddr = vaddr;
+	sim->coremap[frame].prefetched = 1;
+	p->frame = ((uint64_t)frame << PAGE_SHIFT) | PG_ONSWAP | PG_VALID;
+	sim->prefetch_count++;
+
+	insert_page(p);
+	return 0;
+}
+
+/*
+ * The lock-free hit path used when several CPUs replay the trace (see
+ * cpu.c). If the page at vaddr is in memory and the reference needs no
+ * change to its pte other than setting PG_REF, pins its frame, so that the
+ * frame cannot be evicted until unpin_frame(), and returns the frame
+ * number. Otherwise returns -1, and the reference must go through
+ * find_physpage() with the memory lock held.
+ *
+ * PG_REF is the only pte bit ever changed without the lock. An evicting
+ * CPU clears PG_VALID and then waits for the frame's pins to drop to zero,
+ * so either it sees the pin or the pin's recheck of the pte sees the
+ * eviction. Code holding the lock still updates ptes with plain stores;
+ * an aligned 64-bit store is never seen half done, and the only bit a
+ * racing compare-and-swap can lose that way is PG_REF.
+ */
+int pin_frame(addr_t vaddr, char type)
+{
+	pgtbl_entry_t *p = walk_pagetable(vaddr, 0, NULL);
+	if (p == NULL) {
+		return -1;
+	}
+	uint64_t e = __atomic_load_n(&p->frame, __ATOMIC_ACQUIRE);
+	if (!(e & PG_VALID) || ((type == 'S' || type == 'M') && !(e & PG_DIRTY))) {
+		return -1;
+	}
+
+	int frame = e >> PAGE_SHIFT;
+	__atomic_add_fetch(&sim->coremap[frame].pins, 1, __ATOMIC_SEQ_CST);
+	uint64_t cur = __atomic_load_n(&p->frame, __ATOMIC_SEQ_CST);
+	if ((cur | PG_REF) != (e | PG_REF) ||
+	    (!(cur & PG_REF) &&
+	     !__atomic_compare_exchange_n(&p->frame, &cur, cur | PG_REF, 0,
+	                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))) {
+		unpin_frame(frame);
+		return -1;
+	}
+	return frame;
+}
+
+void unpin_frame(int frame)
+{
+	__atomic_sub_fetch(&sim->coremap[frame].pins, 1, __ATOMIC_RELEASE);
+}
+
 /*
  * Locate the physical frame number for the given vaddr using the page table.
  *
@@ -159,65 +654,102 @@ static void init_frame(int frame, addr_t vaddr)
 char *find_physpage(addr_t vaddr, char type)
 {
 	pgtbl_entry_t *p = NULL; // pointer to the full page table entry for vaddr
-	unsigned idx = PGDIR_INDEX(vaddr); // get index into page directory
 
+	unsigned pid = VADDR_PID(vaddr);
 
-	// IMPLEMENTATION NEEDED
-	if(pgdir[idx].pde == 0){
-		pgdir[idx] = init_second_level(); //allocate additional page table 
+	// Read in any pages readahead has asked for since the last reference
+	if (sim->ra) {
+		readahead_run();
+	}
+	if (sim->cleaner) {
+		cleaner_check();
 	}
-	// Use top-level page directory to get pointer to 2nd-level page table
-	pgtbl_entry_t *page_table = (pgtbl_entry_t *)(pgdir[idx].pde & PAGE_MASK);
 
-	// Use vaddr to get index into 2nd-level page table and initialize 'p'
-	unsigned page_table_idx = PGTBL_INDEX(vaddr);
-	p = &page_table[page_table_idx];
+	// The TLB only holds translations for pages that are in memory, so
+	// a TLB hit is also a page hit and skips the page table walk.
+	if (sim->tlb && (p = tlb_lookup(vaddr >> PAGE_SHIFT)) != NULL) {
+		sim->hit_count++;
+		sim->procs[pid].hit_count++;
+		goto referenced;
+	}
 
+	int huge;
+	p = walk_pagetable(vaddr, 1, &huge);
+	sim->walk_count++;
+	sim->huge_walk_count += huge;
 
 	// Check if p is valid or not, on swap or not, and handle appropriately
 	// (Note that the first acess to a page will be marked DIRTY.)
 	if (p->frame & PG_VALID) {
-		hit_count++;
+		sim->hit_count++;
+		sim->procs[pid].hit_count++;
+		struct frame *f = &sim->coremap[p->frame >> PAGE_SHIFT];
+		if (f->prefetched) {
+			f->prefetched = 0;
+			readahead_hit(vaddr >> PAGE_SHIFT);
+		}
 	} else {
-		miss_count++;
+		sim->miss_count++;
+		sim->procs[pid].miss_count++;
 
+		sim->fault_vaddr = vaddr;
 		int frame = allocate_frame(p);
-
-		if(p->frame & PG_ONSWAP){
-			int error = swap_pagein(frame, p->swap_off);
-			assert(error == 0);
-
-			p->frame = frame << PAGE_SHIFT;
-			p->frame = (p->frame & ~PG_DIRTY) | PG_ONSWAP;
-		} else {
-			init_frame(frame, vaddr);
-			p->frame = frame << PAGE_SHIFT;
-			p->frame = p->frame | PG_DIRTY;
-			
+		page_in(frame, p, vaddr);
+		if (sim->ra) {
+			readahead_fault(vaddr >> PAGE_SHIFT);
 		}
+		if (sim->huge) {
+			huge_fault(vaddr, p);
+		}
+	}
+	if (sim->tlb && huge) {
+		addr_t span_mask = ((addr_t)1 << sim->pt_bits[pt_levels - 1]) - 1;
+		tlb_insert_huge((vaddr >> PAGE_SHIFT) >> sim->pt_bits[pt_levels - 1],
+		                p - ((vaddr >> PAGE_SHIFT) & span_mask));
+	} else if (sim->tlb) {
+		tlb_insert(vaddr >> PAGE_SHIFT, p);
 	}
 
+referenced:
+
 
 	// Make sure that p is marked valid and referenced. Also mark it
 	// dirty if the access type indicates that the page will be written to.
+	struct frame *f = &sim->coremap[p->frame >> PAGE_SHIFT];
 	p->frame = p->frame | PG_VALID | PG_REF;
 	if (type == 'S' || type == 'M') {
+		if (!(p->frame & PG_DIRTY)) {
+			sim->num_dirty++;
+			if (f->cleaned) {
+				// Written again after it was cleaned
+				sim->clean_redirty_count++;
+				f->cleaned = 0;
+			}
+		}
 		p->frame = p->frame | PG_DIRTY;
+
+		// The copy of the page in swap (if any) is now out of date, so
+		// its slot is freed. The page gets a new one if it is evicted.
+		if (f->swap_off != INVALID_SWAP) {
+			swap_free(f->swap_off);
+			f->swap_off = INVALID_SWAP;
+		}
 	}
-	ref_count++;
+	sim->ref_count++;
+	f->last_ref = sim->ref_count;
 
 	// Call replacement algorithm's ref_fcn for this page
-	ref_fcn(p);
+	sim->alg.ref(p);
 
 	// Return pointer into (simulated) physical memory at start of frame
-	return &physmem[(p->frame >> PAGE_SHIFT) * SIMPAGESIZE];
+	return &sim->physmem[(p->frame >> PAGE_SHIFT) * SIMPAGESIZE];
 }
 
-void print_pagetable(pgtbl_entry_t *pgtbl)
+void print_pagetable(pgtbl_entry_t *pgtbl, unsigned entries)
 {
 	int first_invalid = -1, last_invalid = -1;
 
-	for (int i = 0; i < PTRS_PER_PGTBL; i++) {
+	for (int i = 0; i < (int)entries; i++) {
 		if (!(pgtbl[i].frame & PG_VALID) && !(pgtbl[i].frame & PG_ONSWAP)) {
 			if (first_invalid == -1) {
 				first_invalid = i;
@@ -235,10 +767,11 @@ void print_pagetable(pgtbl_entry_t *pgtbl)
 				if (pgtbl[i].frame & PG_DIRTY) {
 					printf("DIRTY, ");
 				}
-				printf("in frame %d\n", pgtbl[i].frame >> PAGE_SHIFT);
+				printf("in frame %lu\n", (unsigned long)(pgtbl[i].frame >> PAGE_SHIFT));
 			} else {
 				assert(pgtbl[i].frame & PG_ONSWAP);
-				printf("ONSWAP, at offset %lu\n", (unsigned long)pgtbl[i].swap_off);
+				printf("ONSWAP, at offset %lu\n",
+				       (unsigned long)(pgtbl[i].frame >> PAGE_SHIFT) * SIMPAGESIZE);
 			}			
 		}
 	}
@@ -248,11 +781,12 @@ void print_pagetable(pgtbl_entry_t *pgtbl)
 	}
 }
 
-void print_pagedirectory(void)
+static void print_directory(pgdir_entry_t *pgdir, unsigned level)
 {
 	int first_invalid = -1, last_invalid = -1;
+	int entries = 1 << sim->pt_bits[level];
 
-	for (int i = 0; i < PTRS_PER_PGDIR; i++) {
+	for (int i = 0; i < entries; i++) {
 		if (!(pgdir[i].pde & PG_VALID)) {
 			if (first_invalid == -1) {
 				first_invalid = i;
@@ -260,13 +794,28 @@ void print_pagedirectory(void)
 			last_invalid = i;
 		} else {
 			if (first_invalid != -1) {
-				printf("[%d]: INVALID\n  to\n[%d]: INVALID\n", 
-				       first_invalid, last_invalid);
+				printf("%*s[%d]: INVALID\n%*s  to\n%*s[%d]: INVALID\n",
+				       level * 2, "", first_invalid, level * 2, "",
+				       level * 2, "", last_invalid);
 				first_invalid = last_invalid = -1;
 			}
-			pgtbl_entry_t *pgtbl = (pgtbl_entry_t *)(pgdir[i].pde & PAGE_MASK);
-			printf("[%d]: %p\n", i, pgtbl);
-			print_pagetable(pgtbl);
+			void *table = (void *)(pgdir[i].pde & PAGE_MASK);
+			printf("%*s[%d]: %p\n", level * 2, "", i, table);
+			if (level + 1 == pt_levels - 1) {
+				print_pagetable(table, 1 << sim->pt_bits[level + 1]);
+			} else {
+				print_directory(table, level + 1);
+			}
+		}
+	}
+}
+
+void print_pagedirectory(void)
+{
+	for (unsigned pid = 0; pid < sim->procs_size; pid++) {
+		if (sim->procs[pid].pgdir != NULL) {
+			printf("Process %u:\n", pid);
+			print_directory(sim->procs[pid].pgdir, 0);
 		}
 	}
 }
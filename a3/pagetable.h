@@ -15,7 +15,6 @@
 #ifndef __PAGETABLE_H__
 #define __PAGETABLE_H__
 
-#include <stdio.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -29,74 +28,96 @@
 #define PG_DIRTY     (0x2) // Dirty bit in pgd or pte, set if modified
 #define PG_REF       (0x4) // Reference bit, set if page has been referenced
 #define PG_ONSWAP    (0x8) // Set if page has been evicted to swap
+#define PG_HUGE      (0x10)// Set in the pde above a leaf table mapped as one
+                           // huge page (see huge.c)
 #define INVALID_SWAP -1
 
 #ifdef TRACE_64
 
-// User-level virtual addresses on 64-bit Linux system are 36 bits in our traces
-// and the page size is still 4096 (12 bits). 
-// We split the remaining 24 bits evenly into top-level (page directory) index
-// and second-level (page table) index, using 12 bits for each.
-#define PGDIR_SHIFT      24 // Leaves just top 12 bits of vaddr
-#define PTRS_PER_PGDIR 4096
-#define PTRS_PER_PGTBL 4096
+// User-level virtual addresses on 64-bit Linux systems are at most 48 bits,
+// and the page size is still 4096 (12 bits).
+// By default we split the remaining 36 bits evenly over 4 levels of page
+// table, using 9 bits for each, so every table holds 512 8-byte entries
+// and fills exactly one page (as on x86-64).
+#define VADDR_BITS        48
+#define PT_DEFAULT_LEVELS 4
 
 #else // TRACE_32
 
 // User-level virtual addresses on 32-bit Linux system are 32 bits, and the
 // page size is still 4096 (12 bits).
-// We split the remaining 20 bits evenly into top-level (page directory) index
-// and second level (page table) index, using 10 bits for each.
-#define PGDIR_SHIFT      22 // Leaves just top 10 bits of vaddr
-#define PTRS_PER_PGDIR 1024
-#define PTRS_PER_PGTBL 1024
+// By default we split the remaining 20 bits evenly into top-level (page
+// directory) index and second level (page table) index, using 10 bits for
+// each.
+#define VADDR_BITS        32
+#define PT_DEFAULT_LEVELS 2
 
 #endif
 
-#define PGTBL_MASK     (PTRS_PER_PGTBL - 1)
-#define PGDIR_INDEX(x) ((x) >> PGDIR_SHIFT)
-#define PGTBL_INDEX(x) (((x) >> PAGE_SHIFT) & PGTBL_MASK)
+// The number of levels can be changed at run time (sim -L). The index bits
+// are split as evenly as possible, with any leftover going to the top level.
+#define PT_MIN_LEVELS 2
+#define PT_MAX_LEVELS 6
+
+// A trace can hold the references of several processes. The PID of the
+// process making a reference is kept in the address bits above VADDR_BITS,
+// so the pages of different processes are different pages everywhere in
+// the simulator. Each process has its own page tables (see walk_pagetable()).
+#define PID_BITS 16
+#define PID_MAX  ((1U << PID_BITS) - 1)
+#define VADDR_PID(vaddr)      ((unsigned long)((vaddr) >> VADDR_BITS))
+#define VADDR_TAG(pid, vaddr) (((addr_t)(pid) << VADDR_BITS) | (vaddr))
 
 
 typedef unsigned long addr_t;
 
 // These defines allow us to take advantage of the compiler's typechecking
 
-// Page directory entry (top-level)
+// Page directory entry (every level above the last). Holds a pointer to
+// the next-level table, with PG_VALID in the low bits.
 typedef struct { 
 	uintptr_t pde; 
 } pgdir_entry_t;
 
-// Page table entry (2nd-level). 
+// Page table entry (last level). A single 64-bit word: the PG_ flag bits
+// are in the low PAGE_SHIFT bits, and the bits above them hold either
+// the physical frame holding vpage (if PG_VALID is set), or the slot in
+// the swap file holding vpage (if PG_VALID is clear and PG_ONSWAP is set).
+// The swap offset of a page that is in memory is kept in its coremap entry.
 typedef struct { 
-	unsigned int frame; // if valid bit == 1, physical frame holding vpage
-	off_t swap_off;     // offset in swap file of vpage, if any
-} pgtbl_entry_t;    
+	uint64_t frame;
+} pgtbl_entry_t;
 
 void init_pagetable(void);
+void destroy_pagetable(void);
 char *find_physpage(addr_t vaddr, char type);
+int pin_frame(addr_t vaddr, char type);
+void unpin_frame(int frame);
+void reserve_procs(unsigned max_pid);
+void clean_frame(int frame);
+int prefetch_page(addr_t vaddr);
+void fill_page(pgtbl_entry_t *p, addr_t vaddr);
+void clean_frames(const unsigned *frames, unsigned n);
+pgdir_entry_t *leaf_pde(addr_t vaddr);
 
 void print_pagedirectory(void);
 
-typedef struct list_entry {
-	int frame;
-	struct list_entry *prev;
-	struct list_entry *next;
-} list_entry_t;
-
-
 struct frame {
 	char in_use;       // True if frame is allocated, False if frame is free
 	pgtbl_entry_t *pte;// Pointer back to pagetable entry (pte) for page
 	                   // stored in this frame
-	list_entry_t *entry; // pointer to the entry with this frame's frame number in lru's linked list 
+	int swap_off;      // Offset in swap file of a copy of the page, if any
+	addr_t vaddr;      // Virtual address of the page stored in this frame
+	char prefetched;   // Read ahead and not referenced yet
+	char cleaned;      // Written to swap by clean_frame() and still clean
+	unsigned long last_ref; // Value of sim->ref_count at the last reference
+	unsigned pins;     // CPUs using the frame without the memory lock
 };
 
-/* The coremap holds information about physical memory.
+/* The coremap (sim->coremap) holds information about physical memory.
  * The index into coremap is the physical page frame number stored
  * in the page table entry (pgtbl_entry_t).
  */
-extern struct frame *coremap;
 
 
 // Swap functions for use in other files
@@ -104,28 +125,114 @@ int swap_init(unsigned swapsize);
 void swap_destroy(void);
 int swap_pagein(unsigned frame, int swap_offset);
 int swap_pageout(unsigned frame, int swap_offset);
+int swap_pageout_cluster(const unsigned *frames, int n);
+void swap_free(int swap_offset);
+void swap_flush(void);
+void swap_print_stats(void);
+
+// TLB functions (see tlb.c)
+void tlb_init(void);
+void tlb_destroy(void);
+pgtbl_entry_t *tlb_lookup(addr_t vpage);
+void tlb_insert(addr_t vpage, pgtbl_entry_t *p);
+void tlb_invalidate(addr_t vpage);
+void tlb_insert_huge(addr_t region, pgtbl_entry_t *leaf);
+void tlb_invalidate_huge(addr_t region);
+
+// Huge page functions (see huge.c)
+void huge_init(void);
+void huge_destroy(void);
+int huge_alloc_frame(addr_t vaddr);
+void huge_frame_used(unsigned frame);
+void huge_frame_freed(unsigned frame);
+int huge_break_reservation(void);
+void huge_evicting(unsigned frame);
+void huge_fault(addr_t vaddr, pgtbl_entry_t *p);
+
+// Readahead functions (see readahead.c)
+void readahead_init(void);
+void readahead_destroy(void);
+void readahead_run(void);
+void readahead_fault(addr_t vpage);
+void readahead_hit(addr_t vpage);
+
+// Page cleaner functions (see cleaner.c)
+void cleaner_init(void);
+void cleaner_destroy(void);
+void cleaner_check(void);
+
+// Concurrent replay functions (see cpu.c)
+void cpu_init(void);
+void cpu_destroy(void);
 
 // These may not need to do anything for some algorithms
 void rand_init(void);
 void lru_init(void);
 void clock_init(void);
 void fifo_init(void);
+void opt_init(void);
+void arc_init(void);
+void twoq_init(void);
+void lirs_init(void);
+void wsclock_init(void);
+void aging_init(void);
+void lru_sampled_init(void);
 
 // These may not need to do anything for some algorithms
 void rand_cleanup(void);
 void lru_cleanup(void);
 void clock_cleanup(void);
 void fifo_cleanup(void);
+void opt_cleanup(void);
+void arc_cleanup(void);
+void twoq_cleanup(void);
+void lirs_cleanup(void);
+void wsclock_cleanup(void);
+void aging_cleanup(void);
+void lru_sampled_cleanup(void);
 
 // These may not need to do anything for some algorithms
 void rand_ref(pgtbl_entry_t *);
 void lru_ref(pgtbl_entry_t *);
 void clock_ref(pgtbl_entry_t *);
 void fifo_ref(pgtbl_entry_t *);
+void opt_ref(pgtbl_entry_t *);
+void arc_ref(pgtbl_entry_t *);
+void twoq_ref(pgtbl_entry_t *);
+void lirs_ref(pgtbl_entry_t *);
+void wsclock_ref(pgtbl_entry_t *);
+void aging_ref(pgtbl_entry_t *);
+void lru_sampled_ref(pgtbl_entry_t *);
+
+// Optional: take in a page brought in without a reference, by readahead or
+// to fill a huge page, without marking it referenced
+void clock_insert(pgtbl_entry_t *);
+void opt_insert(pgtbl_entry_t *);
+void twoq_insert(pgtbl_entry_t *);
+void wsclock_insert(pgtbl_entry_t *);
+void aging_insert(pgtbl_entry_t *);
 
 int rand_evict(void);
 int lru_evict(void);
 int clock_evict(void);
 int fifo_evict(void);
+int opt_evict(void);
+int arc_evict(void);
+int twoq_evict(void);
+int lirs_evict(void);
+int wsclock_evict(void);
+int aging_evict(void);
+int lru_sampled_evict(void);
+
+// Optional: choose up to max victims at once (see reclaim_frames())
+unsigned lru_evict_batch(unsigned *frames, unsigned max);
+unsigned clock_evict_batch(unsigned *frames, unsigned max);
+unsigned fifo_evict_batch(unsigned *frames, unsigned max);
+
+// Optional: choose a victim among the pages of process pid, for local
+// replacement (see local_victim_pid())
+int lru_evict_proc(unsigned pid);
+int clock_evict_proc(unsigned pid);
+int fifo_evict_proc(unsigned pid);
 
 #endif /* __PAGETABLE_H__ */
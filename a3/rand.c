@@ -15,6 +15,13 @@
 #include "pagetable.h"
 #include "sim.h"
 
+// Each simulation has its own random number generator, seeded the same way
+// as random(), so concurrent simulations do not share one sequence.
+struct rand_data {
+	struct random_data buf;
+	char state[128];
+};
+
 /* Page to evict is chosen using the RAND algorithm.
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
@@ -22,7 +29,10 @@
 int rand_evict(void)
 {
 	// choose index in coremap to evict a page from
-	return (int)(random() % memsize);
+	struct rand_data *r = sim->alg_data;
+	int32_t result;
+	random_r(&r->buf, &result);
+	return (int)(result % sim->memsize);
 }
 
 /* This function is called on each access to a page to update any information
@@ -38,9 +48,13 @@ void rand_ref(pgtbl_entry_t *p)
 /* Initialize any data structures needed for this replacement algorithm. */
 void rand_init(void)
 {
+	struct rand_data *r = calloc(1, sizeof(struct rand_data));
+	initstate_r(1, r->state, sizeof(r->state), &r->buf);
+	sim->alg_data = r;
 }
 
 /* Cleanup any data structures created in rand_init(). */
 void rand_cleanup(void)
 {
+	free(sim->alg_data);
 }
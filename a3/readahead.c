@@ -0,0 +1,174 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Adaptive sequential readahead of swapped-out pages.
+ *
+ * Faults are tracked per region of 2^RA_REGION_SHIFT virtual pages. A fault
+ * on the page after the region's previous fault starts a stream: the next
+ * few pages that are on swap are read in ahead of use. The first page of
+ * each window read ahead is its marker. When the marker is referenced the
+ * stream is still going, so the next window is read in at twice the size,
+ * up to readahead_max pages. A stream that runs into the next region
+ * carries on there.
+ *
+ * Pages are read in at the start of the next reference rather than inside
+ * the fault, so the eviction they cause can never take the page that the
+ * current reference is using.
+ */
+#include "pagetable.h"
+#include "sim.h"
+
+#define RA_REGION_SHIFT 9     // 512 pages, the span of one leaf page table
+#define RA_STREAMS      64
+#define RA_INIT_WINDOW  4
+#define RA_NONE         ((addr_t)-1)
+
+// Largest readahead window in pages (sim -R); 0 disables readahead
+unsigned readahead_max = 0;
+
+struct stream {
+	addr_t region;  // RA_NONE if the entry is unused
+	addr_t last;    // Last page faulted on or read ahead and then used
+	addr_t marker;  // First page of the latest window
+	addr_t next;    // Page after the latest window
+	unsigned window;
+};
+
+struct readahead {
+	struct stream streams[RA_STREAMS];
+
+	// Window to read in at the start of the next reference
+	addr_t pending_start;
+	unsigned pending_count;
+};
+
+static struct stream *find_stream(struct readahead *ra, addr_t vpage, int create)
+{
+	addr_t region = vpage >> RA_REGION_SHIFT;
+	struct stream *s = &ra->streams[region % RA_STREAMS];
+
+	if (s->region == region) {
+		return s;
+	}
+
+	// A stream that ran off the end of the previous region
+	struct stream *prev = &ra->streams[(region - 1) % RA_STREAMS];
+	if (region > 0 && prev->region == region - 1 &&
+	    (prev->last + 1 == vpage || prev->marker == vpage)) {
+		*s = *prev;
+		s->region = region;
+		prev->region = RA_NONE;
+		return s;
+	}
+
+	if (!create) {
+		return NULL;
+	}
+	s->region = region;
+	s->last = s->marker = s->next = RA_NONE;
+	s->window = 0;
+	return s;
+}
+
+static void schedule(struct readahead *ra, struct stream *s, addr_t start)
+{
+	unsigned window = s->window ? 2 * s->window : RA_INIT_WINDOW;
+	s->window = window < readahead_max ? window : readahead_max;
+	s->marker = start;
+	s->next = start + s->window;
+	ra->pending_start = start;
+	ra->pending_count = s->window;
+}
+
+void readahead_init(void)
+{
+	if (readahead_max == 0) {
+		sim->ra = NULL;
+		return;
+	}
+	struct readahead *ra = malloc(sizeof(struct readahead));
+	if (ra == NULL) {
+		perror("readahead_init: malloc");
+		exit(1);
+	}
+	for (int i = 0; i < RA_STREAMS; i++) {
+		ra->streams[i].region = RA_NONE;
+	}
+	ra->pending_count = 0;
+	sim->ra = ra;
+}
+
+void readahead_destroy(void)
+{
+	free(sim->ra);
+	sim->ra = NULL;
+}
+
+/* Reads in the window scheduled by the last fault or marker hit, if any. */
+void readahead_run(void)
+{
+	struct readahead *ra = sim->ra;
+	addr_t start = ra->pending_start;
+	unsigned count = ra->pending_count;
+
+	if (count == 0) {
+		return;
+	}
+	ra->pending_count = 0;
+	for (unsigned i = 0; i < count; i++) {
+		addr_t vaddr = (start + i) << PAGE_SHIFT;
+		if (VADDR_PID(vaddr) != VADDR_PID(start << PAGE_SHIFT)) {
+			break;  // past the end of the process's address space
+		}
+		prefetch_page(vaddr);
+	}
+}
+
+/* Called on a miss on vpage. A miss on the page after the last one in the
+ * same stream schedules a window of readahead.
+ */
+void readahead_fault(addr_t vpage)
+{
+	struct readahead *ra = sim->ra;
+	struct stream *s = find_stream(ra, vpage, 1);
+
+	if (s->last != RA_NONE && s->last + 1 == vpage) {
+		// A fault inside a window means its pages were evicted before
+		// use, so start again from a small window
+		if (s->next != RA_NONE && vpage < s->next) {
+			s->window = 0;
+		}
+		schedule(ra, s, vpage + 1);
+	} else {
+		s->window = 0;
+		s->marker = s->next = RA_NONE;
+	}
+	s->last = vpage;
+}
+
+/* Called on the first reference to a page that was read ahead. */
+void readahead_hit(addr_t vpage)
+{
+	struct readahead *ra = sim->ra;
+	struct stream *s = find_stream(ra, vpage, 0);
+
+	sim->prefetch_hit_count++;
+	if (s == NULL) {
+		return;
+	}
+	s->last = vpage;
+	if (vpage == s->marker) {
+		schedule(ra, s, s->next);
+	}
+}
@@ -18,32 +18,34 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "sim.h"
 #include "pagetable.h"
+#include "trace.h"
 
 // Define global variables declared in sim.h
-unsigned memsize = 0;
 int debug = 0;
-char *physmem = NULL;
-struct frame *coremap = NULL;
 char *tracefile = NULL;
+__thread struct sim *sim = NULL;
 
 /* The algs array gives us a mapping between the name of an eviction
  * algorithm as given in a command line argument, and the function to
  * call to select the victim page.
  */
 struct functions algs[] = {
-	{"rand", rand_init, rand_cleanup, rand_ref, rand_evict},
-	{"lru", lru_init, lru_cleanup, lru_ref, lru_evict},
-	{"fifo", fifo_init, fifo_cleanup, fifo_ref, fifo_evict},
-	{"clock", clock_init, clock_cleanup, clock_ref, clock_evict},
+	{"rand", rand_init, rand_cleanup, rand_ref, NULL, rand_evict, NULL, NULL, REF_ATOMIC},
+	{"lru", lru_init, lru_cleanup, lru_ref, NULL, lru_evict, lru_evict_batch, lru_evict_proc, REF_LOCKED},
+	{"fifo", fifo_init, fifo_cleanup, fifo_ref, NULL, fifo_evict, fifo_evict_batch, fifo_evict_proc, REF_ATOMIC},
+	{"clock", clock_init, clock_cleanup, clock_ref, clock_insert, clock_evict, clock_evict_batch, clock_evict_proc, REF_ATOMIC},
+	{"opt", opt_init, opt_cleanup, opt_ref, opt_insert, opt_evict, NULL, NULL, REF_SERIAL},
+	{"arc", arc_init, arc_cleanup, arc_ref, NULL, arc_evict, NULL, NULL, REF_LOCKED},
+	{"2q", twoq_init, twoq_cleanup, twoq_ref, twoq_insert, twoq_evict, NULL, NULL, REF_ATOMIC},
+	{"lirs", lirs_init, lirs_cleanup, lirs_ref, NULL, lirs_evict, NULL, NULL, REF_LOCKED},
+	{"wsclock", wsclock_init, wsclock_cleanup, wsclock_ref, wsclock_insert, wsclock_evict, NULL, NULL, REF_SERIAL},
+	{"aging", aging_init, aging_cleanup, aging_ref, aging_insert, aging_evict, NULL, NULL, REF_LOCKED},
+	{"lru-sampled", lru_sampled_init, lru_sampled_cleanup, lru_sampled_ref, NULL, lru_sampled_evict, NULL, NULL, REF_LOCKED},
 };
-int num_algs = 4;
-
-void (*init_fcn)() = NULL;
-void (*cleanup_fcn)() = NULL;
-void (*ref_fcn)(pgtbl_entry_t *) = NULL;
-int (*evict_fcn)() = NULL;
+int num_algs = 11;
 
 
 /* An actual memory access based on the vaddr from the trace file.
@@ -62,7 +64,12 @@ int (*evict_fcn)() = NULL;
  */
 void access_mem(char type, addr_t vaddr)
 {
-	char *memptr = find_physpage(vaddr, type);
+	access_page(find_physpage(vaddr, type), type, vaddr);
+}
+
+/* The memory access itself, once vaddr has been translated to memptr. */
+void access_page(char *memptr, char type, addr_t vaddr)
+{
 	int *versionptr = (int *)memptr;
 	addr_t *checkaddr = (addr_t *)(memptr + sizeof(int));
 
@@ -71,46 +78,184 @@ void access_mem(char type, addr_t vaddr)
 	}
 	
 	if (type == 'S' || type == 'M') {
-		// write access to page, increment version number
-		(*versionptr)++;
+		// write access to page, increment version number. With several
+		// CPUs, write hits to the same page can run at once outside the
+		// memory lock (see cpu.c), so the increment must be atomic.
+		if (sim->cpus) {
+			__atomic_fetch_add(versionptr, 1, __ATOMIC_RELAXED);
+		} else {
+			(*versionptr)++;
+		}
 	}
 }
 
 
-void replay_trace(FILE *infp)
+/* Replays every reference in the trace through access_mem().
+ * A binary trace is read straight out of the mapped file, so there is no
+ * per-reference parsing or copying. A compressed trace is decoded and
+ * replayed a block at a time.
+ */
+void replay_trace(struct trace *t)
 {
-	char buf[MAXLINE];
+	char type;
+	addr_t vaddr;
 
-	while (fgets(buf, MAXLINE, infp) != NULL) {
-		if (buf[0] != '=') {
-			addr_t vaddr = 0;
-			char type;
-
-			sscanf(buf, "%c %lx", &type, &vaddr);
-			if (debug)  {
-				printf("%c %lx\n", type, vaddr);
+	if (t->recs && !debug) {
+		const trace_rec_t *r = t->recs;
+		const trace_rec_t *end = r + t->nrecs;
+		for (; r < end; r++) {
+			access_mem(TRACE_REC_TYPE(*r), TRACE_REC_VADDR(*r));
+		}
+		return;
+	}
+	if (t->compressed && !debug) {
+		const trace_rec_t *r;
+		size_t n;
+		while ((n = trace_next_block(t, &r)) > 0) {
+			for (size_t i = 0; i < n; i++) {
+				access_mem(TRACE_REC_TYPE(r[i]), TRACE_REC_VADDR(r[i]));
 			}
-			access_mem(type, vaddr);
 		}
+		return;
+	}
+
+	while (trace_next(t, &type, &vaddr)) {
+		if (debug)  {
+			printf("%c %lx\n", type, vaddr);
+		}
+		access_mem(type, vaddr);
 	}
 }
 
 
+/* Creates a simulation of memsize frames that will replay trace using the
+ * replacement algorithm alg, and makes it the calling thread's current
+ * simulation.
+ */
+struct sim *sim_create(unsigned memsize, unsigned swapsize,
+                       struct functions *alg, struct trace *trace)
+{
+	struct sim *s = calloc(1, sizeof(struct sim));
+	if (s == NULL) {
+		perror("Failed to allocate simulation");
+		exit(1);
+	}
+	s->memsize = memsize;
+	s->trace = trace;
+	s->alg = *alg;
+	sim = s;
+	if (local_replacement && alg->evict_proc == NULL) {
+		fprintf(stderr, "Error: %s does not support local replacement\n",
+		        alg->name);
+		exit(1);
+	}
+
+	// Initialize main data structures for simulation.
+	// This happens before calling the replacement algorithm init function
+	// so that the init_fcn can refer to the coremap if needed.
+	s->coremap = calloc(memsize, sizeof(struct frame));
+	s->physmem = calloc(memsize, SIMPAGESIZE);
+	if (s->coremap == NULL || s->physmem == NULL) {
+		perror("Failed to allocate simulated memory");
+		exit(1);
+	}
+	swap_init(swapsize);
+	init_pagetable();
+	tlb_init();
+	readahead_init();
+	cleaner_init();
+	huge_init();
+	cpu_init();
+	return s;
+}
+
+/* Replays the whole trace through simulation s on the calling thread. */
+void sim_run(struct sim *s)
+{
+	sim = s;
+
+	// Call replacement algorithm's init_fcn before replaying trace.
+	s->alg.init();
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (s->cpus) {
+		cpu_run(s);
+	} else {
+		replay_trace(s->trace);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	s->replay_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	// print_pagedirectory();
+
+	// Wait for any queued writes, so the swap statistics are complete
+	swap_flush();
+
+	s->alg.cleanup();
+}
+
+/* Frees simulation s. Its counters must be read before this is called. */
+void sim_destroy(struct sim *s)
+{
+	sim = s;
+
+	// Cleanup - removes temporary swapfile.
+	swap_destroy();
+	tlb_destroy();
+	readahead_destroy();
+	cleaner_destroy();
+	huge_destroy();
+	cpu_destroy();
+	destroy_pagetable();
+	free(s->coremap);
+	free(s->physmem);
+	free(s);
+	sim = NULL;
+}
+
+static struct functions *find_alg(const char *name)
+{
+	for (int i = 0; i < num_algs; i++) {
+		if (strcmp(algs[i].name, name) == 0) {
+			return &algs[i];
+		}
+	}
+	fprintf(stderr, "Error: invalid replacement algorithm - %s\n", name);
+	exit(1);
+}
+
+
 int main(int argc, char *argv[])
 {
 	int opt;
 	unsigned swapsize = 4096;
-	FILE *tfp = stdin;
+	struct trace *trace;
 	char *replacement_alg = NULL;
-	char *usage = "USAGE: sim -f tracefile -m memorysize -s swapsize -a algorithm\n";
+	char *memsizes = NULL;
+	int all_sizes = 0;
+	unsigned maxmem = 0;
+	int nthreads = 0;
+	char *usage = "USAGE: sim -f tracefile -m memorysize -s swapsize -a algorithm [-b file|mmap|mem] [-w depth] [-L levels]\n"
+	              "           [-t entries[,ways[,lru|rand]]] [-T tau] [-A tick] [-S samples[,pool]]\n"
+	              "           [-R readahead] [-C interval[,low,high]] [-B batch]\n"
+	              "           [-P global|local] [-c cpus] [-H percent] [-Z percent]\n"
+	              "       sim -f tracefile -m all [-l maxmemsize] -a lru\n"
+	              "       sim -f tracefile -m size,size,... -s swapsize -a all|alg,alg,... [-j threads]\n";
 
-	while ((opt = getopt(argc, argv, "f:m:a:s:")) != -1) {
+	while ((opt = getopt(argc, argv, "f:m:a:s:l:j:b:w:L:t:T:A:S:R:C:B:P:c:H:Z:")) != -1) {
 		switch (opt) {
 		case 'f':
 			tracefile = optarg;
 			break;
 		case 'm':
-			memsize = (unsigned)strtoul(optarg, NULL, 10);
+			if (strcmp(optarg, "all") == 0) {
+				all_sizes = 1;
+			} else {
+				memsizes = optarg;
+			}
+			break;
+		case 'l':
+			maxmem = (unsigned)strtoul(optarg, NULL, 10);
 			break;
 		case 'a':
 			replacement_alg = optarg;
@@ -118,63 +263,222 @@ int main(int argc, char *argv[])
 		case 's':
 			swapsize = (unsigned)strtoul(optarg, NULL, 10);
 			break;
+		case 'j':
+			nthreads = (int)strtol(optarg, NULL, 10);
+			break;
+		case 'b':
+			swap_backend = optarg;
+			break;
+		case 'w':
+			writeback_depth = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'L':
+			pt_levels = (unsigned)strtoul(optarg, NULL, 10);
+			if (pt_levels < PT_MIN_LEVELS || pt_levels > PT_MAX_LEVELS) {
+				fprintf(stderr, "Error: page table levels must be between %d and %d\n",
+				        PT_MIN_LEVELS, PT_MAX_LEVELS);
+				exit(1);
+			}
+			break;
+		case 'B':
+			reclaim_batch = (unsigned)strtoul(optarg, NULL, 10);
+			if (reclaim_batch == 0) {
+				fprintf(stderr, "Error: reclaim batch must be at least 1\n");
+				exit(1);
+			}
+			break;
+		case 'Z':
+			zswap_percent = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'H':
+			huge_threshold = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			num_cpus = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'P':
+			if (strcmp(optarg, "local") == 0) {
+				local_replacement = 1;
+			} else if (strcmp(optarg, "global") != 0) {
+				fprintf(stderr, "Error: replacement must be global or local\n");
+				exit(1);
+			}
+			break;
+		case 'C': {
+			char *end;
+			cleaner_interval = strtoul(optarg, &end, 10);
+			if (*end == ',') {
+				cleaner_low = (unsigned)strtoul(end + 1, &end, 10);
+				if (*end == ',') {
+					cleaner_high = (unsigned)strtoul(end + 1, NULL, 10);
+				}
+			}
+			break;
+		}
+		case 'R':
+			readahead_max = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'S': {
+			char *pool = strchr(optarg, ',');
+			lru_samples = (unsigned)strtoul(optarg, NULL, 10);
+			if (pool) {
+				lru_pool = (unsigned)strtoul(pool + 1, NULL, 10);
+			}
+			break;
+		}
+		case 'A':
+			aging_tick = strtoul(optarg, NULL, 10);
+			break;
+		case 'T':
+			wsclock_tau = strtoul(optarg, NULL, 10);
+			break;
+		case 't': {
+			char *ways = strchr(optarg, ',');
+			tlb_entries = (unsigned)strtoul(optarg, NULL, 10);
+			if (ways) {
+				char *policy = strchr(ways + 1, ',');
+				tlb_ways = (unsigned)strtoul(ways + 1, NULL, 10);
+				if (policy) {
+					tlb_policy = policy + 1;
+				}
+			}
+			break;
+		}
 		default:
 			fprintf(stderr, "%s", usage);
 			exit(1);
 		}
 	}
-	if (!tracefile || !replacement_alg) {
+	if (!tracefile || !replacement_alg || (!memsizes && !all_sizes)) {
 		fprintf(stderr, "%s", usage);
 		exit(1);
 	}
 
-	if ((tfp = fopen(tracefile, "r")) == NULL) {
-		perror("Error opening tracefile:");
+	if ((trace = trace_open(tracefile)) == NULL) {
 		exit(1);
 	}
 
-	// Initialize main data structures for simulation.
-	// This happens before calling the replacement algorithm init function
-	// so that the init_fcn can refer to the coremap if needed.
-	coremap = calloc(memsize, sizeof(struct frame));
-	physmem = calloc(memsize, SIMPAGESIZE);
-	swap_init(swapsize);
-	init_pagetable();
+	// With -m all, print the LRU miss-ratio curve instead of simulating
+	// a single memory size.
+	if (all_sizes) {
+		if (strcmp(replacement_alg, "lru") != 0) {
+			fprintf(stderr, "Error: -m all is only supported for lru\n");
+			exit(1);
+		}
+		mrc_run(trace, maxmem);
+		trace_close(trace);
+		return 0;
+	}
 
-	for (int i = 0; i < num_algs; i++) {
-		if (strcmp(algs[i].name, replacement_alg) == 0) {
-			init_fcn = algs[i].init;
-			cleanup_fcn = algs[i].cleanup;
-			ref_fcn = algs[i].ref;
-			evict_fcn = algs[i].evict;
-			break;
+	// Both -a and -m take comma-separated lists; -a all means every
+	// algorithm in algs.
+	struct functions *run_algs[num_algs];
+	int nalgs = 0;
+	if (strcmp(replacement_alg, "all") == 0) {
+		for (nalgs = 0; nalgs < num_algs; nalgs++) {
+			run_algs[nalgs] = &algs[nalgs];
+		}
+	} else {
+		for (char *name = strtok(replacement_alg, ","); name;
+		     name = strtok(NULL, ",")) {
+			if (nalgs == num_algs) {
+				fprintf(stderr, "%s", usage);
+				exit(1);
+			}
+			run_algs[nalgs++] = find_alg(name);
 		}
 	}
-	if (evict_fcn == NULL) {
-		fprintf(stderr, "Error: invalid replacement algorithm - %s\n",
-				replacement_alg);
+
+	unsigned sizes[strlen(memsizes) / 2 + 1];
+	int nsizes = 0;
+	for (char *size = strtok(memsizes, ","); size; size = strtok(NULL, ",")) {
+		sizes[nsizes++] = (unsigned)strtoul(size, NULL, 10);
+	}
+	if (nalgs == 0 || nsizes == 0) {
+		fprintf(stderr, "%s", usage);
 		exit(1);
 	}
 
-	// Call replacement algorithm's init_fcn before replaying trace.
-	init_fcn();
-
-	replay_trace(tfp);
-	// print_pagedirectory();
-
-	cleanup_fcn();
+	// More than one algorithm or memory size (or -j) runs a sweep: every
+	// combination is simulated, in parallel, and reported in one table.
+	if (nalgs > 1 || nsizes > 1 || nthreads > 0) {
+		sweep_run(trace, run_algs, nalgs, sizes, nsizes, swapsize, nthreads);
+		trace_close(trace);
+		return 0;
+	}
 
-	// Cleanup - removes temporary swapfile.
-	swap_destroy();
+	struct sim *s = sim_create(sizes[0], swapsize, run_algs[0], trace);
+	sim_run(s);
+	trace_close(trace);
 
 	printf("\n");
-	printf("Hit count: %d\n", hit_count);
-	printf("Miss count: %d\n", miss_count);
-	printf("Clean evictions: %d\n", evict_clean_count);
-	printf("Dirty evictions: %d\n", evict_dirty_count);
-	printf("Total references : %d\n", ref_count);
-	printf("Hit rate: %.4f\n", (double)hit_count / ref_count * 100);
-	printf("Miss rate: %.4f\n", (double)miss_count / ref_count * 100);
-		
+	printf("Hit count: %d\n", s->hit_count);
+	printf("Miss count: %d\n", s->miss_count);
+	printf("Clean evictions: %d\n", s->evict_clean_count);
+	printf("Dirty evictions: %d\n", s->evict_dirty_count);
+	printf("Total references : %d\n", s->ref_count);
+	printf("Hit rate: %.4f\n", (double)s->hit_count / s->ref_count * 100);
+	printf("Miss rate: %.4f\n", (double)s->miss_count / s->ref_count * 100);
+	if (s->ghost_recent_hit_count || s->ghost_frequent_hit_count) {
+		printf("Ghost hits (recent): %d\n", s->ghost_recent_hit_count);
+		printf("Ghost hits (frequent): %d\n", s->ghost_frequent_hit_count);
+	}
+	if (s->clean_write_count) {
+		printf("Pages cleaned before eviction: %d\n", s->clean_write_count);
+		printf("Cleaned pages evicted clean: %d\n", s->clean_saved_count);
+		printf("Cleaned pages written again: %d\n", s->clean_redirty_count);
+	}
+	if (s->cleaner) {
+		printf("Page cleaner runs: %d\n", s->cleaner_run_count);
+	}
+	if (reclaim_batch > 1 && s->reclaim_count) {
+		printf("Reclaims: %d (%.2f frames each)\n", s->reclaim_count,
+		       (double)(s->evict_clean_count + s->evict_dirty_count) / s->reclaim_count);
+		printf("Clustered swap writes: %d (%d pages)\n", s->cluster_write_count,
+		       s->cluster_page_count);
+	}
+	if (s->ra) {
+		printf("Pages read ahead: %d\n", s->prefetch_count);
+		printf("Readahead hits: %d\n", s->prefetch_hit_count);
+		printf("Wasted readahead: %d\n", s->prefetch_wasted_count);
+		printf("Evictions for readahead: %d\n", s->prefetch_evict_count);
+	}
+	if (s->tlb) {
+		printf("TLB hit count: %d\n", s->tlb_hit_count);
+		printf("TLB miss count: %d\n", s->tlb_miss_count);
+		printf("TLB hit rate: %.4f\n", (double)s->tlb_hit_count / s->ref_count * 100);
+	}
+	if (s->huge) {
+		printf("Huge page promotions: %d (%d pages filled)\n",
+		       s->huge_promote_count, s->huge_fill_count);
+		printf("Huge page demotions: %d\n", s->huge_demote_count);
+		printf("Huge page reservations given up: %d\n", s->huge_break_count);
+		printf("Page table walks: %d (%d stopped at a huge page)\n",
+		       s->walk_count, s->huge_walk_count);
+		if (s->tlb) {
+			printf("TLB hits on huge pages: %d\n", s->tlb_huge_hit_count);
+		}
+	}
+	if (s->num_procs > 1) {
+		printf("\n%6s %10s %10s %10s %10s %10s\n", "PID", "Hits", "Misses",
+		       "Evictions", "Stolen", "Resident");
+		for (unsigned pid = 0; pid < s->procs_size; pid++) {
+			struct proc *proc = &s->procs[pid];
+			if (proc->pgdir != NULL) {
+				printf("%6u %10d %10d %10d %10d %10u\n", pid, proc->hit_count,
+				       proc->miss_count, proc->evict_count,
+				       proc->stolen_count, proc->resident);
+			}
+		}
+	}
+	cpu_print_stats(s);
+	if (writeback_depth > 0) {
+		printf("Replay time: %.4f s\n", s->replay_time);
+	}
+	if (writeback_depth > 0 || zswap_percent > 0) {
+		swap_print_stats();
+	}
+
+	sim_destroy(s);
 	return 0;
 }
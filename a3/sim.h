@@ -20,37 +20,234 @@
 #define MAXLINE 256
 #define SIMPAGESIZE 16  /* Simulated physical memory page frame size */
 
-extern unsigned memsize;
 extern int debug;
 
-extern int hit_count;
-extern int miss_count;
-extern int ref_count;
-extern int evict_clean_count;
-extern int evict_dirty_count;
+/* The tracefile name is a global variable because it is shared by every
+ * simulation in a run. Algorithms that need to read the trace before it
+ * is replayed (such as OPT) use the simulation's trace instead.
+ */
+extern char *tracefile;
+
+/* Name of the swap backend each simulation uses (see swap.c) */
+extern char *swap_backend;
 
-/* We simulate physical memory with a large array of bytes */
-extern char *physmem;
+/* Depth of the asynchronous writeback queue, or 0 to write synchronously */
+extern unsigned writeback_depth;
 
-/* The tracefile name is a global variable because the OPT
- * algorithm will need to read the file before you start
- * replaying the trace.
+/* Size of the compressed swap pool in percent of memory, or 0 for none
+ * (see zswap.c)
  */
-extern char *tracefile;
+extern unsigned zswap_percent;
+
+/* Number of levels of page table (see pagetable.h) */
+extern unsigned pt_levels;
+
+/* Simulated TLB: number of entries (0 for no TLB), ways per set, and the
+ * replacement policy within a set, "lru" or "rand" (see tlb.c)
+ */
+extern unsigned tlb_entries;
+extern unsigned tlb_ways;
+extern char *tlb_policy;
+
+/* Working set window of the wsclock algorithm, in references */
+extern unsigned long wsclock_tau;
+
+/* References between ticks of the aging algorithm */
+extern unsigned long aging_tick;
+
+/* Frames sampled per eviction and eviction pool size of lru-sampled */
+extern unsigned lru_samples;
+extern unsigned lru_pool;
+
+/* Largest readahead window in pages, or 0 for no readahead (see readahead.c) */
+extern unsigned readahead_max;
+
+/* Page cleaner interval in references (0 for no cleaner), and its low and
+ * high watermarks of free or clean frames, in percent (see cleaner.c)
+ */
+extern unsigned long cleaner_interval;
+extern unsigned cleaner_low;
+extern unsigned cleaner_high;
+
+/* Frames freed at a time when memory is full (see reclaim_frames()) */
+extern unsigned reclaim_batch;
+
+/* Set for local replacement: a process that holds its share of memory
+ * replaces one of its own pages (see local_victim_pid())
+ */
+extern int local_replacement;
+
+/* Percent of a huge page's base pages that must be in memory before it is
+ * promoted, or 0 for no huge pages (see huge.c)
+ */
+extern unsigned huge_threshold;
+
+/* Number of simulated CPUs replaying the trace at once (see cpu.c) */
+extern unsigned num_cpus;
+
+/* How an algorithm's ref function can be called when several CPUs replay
+ * the trace at once (see cpu.c)
+ */
+enum ref_mode {
+	REF_SERIAL,  // Only one CPU is supported
+	REF_LOCKED,  // Every reference goes through the memory lock
+	REF_ATOMIC,  // A hit only needs PG_REF set, which can be done lock-free
+};
 
 /* Each eviction algorithm is represented by a structure with its name
- * and three functions.
+ * and four functions, and optionally others that take in a page brought
+ * in without a reference, choose several victims at once, and choose a
+ * victim among the pages of one process.
  */
 struct functions {
 	char *name;                  // String name of eviction algorithm
 	void (*init)(void);          // Initialize any data needed by alg
 	void (*cleanup)(void);       // Cleanup any data initialized in init()
 	void (*ref)(pgtbl_entry_t *);// Called on each reference
+	void (*insert)(pgtbl_entry_t *); // Page brought in without a reference,
+	                             // or NULL if ref() does the same for it
 	int (*evict)(void);          // Called to choose victim for eviction
+	unsigned (*evict_batch)(unsigned *, unsigned); // Up to n victims, or NULL
+	int (*evict_proc)(unsigned pid); // Victim among pid's pages, or NULL
+	enum ref_mode ref_mode;      // Support for several CPUs
+};
+
+extern struct functions algs[];
+extern int num_algs;
+
+struct trace;
+struct swap;
+struct tlb;
+struct readahead;
+struct cleaner;
+struct cpus;
+struct huge;
+
+/* A process in the trace, created the first time one of its references is
+ * seen. The counters are the process's share of the ones in struct sim.
+ */
+struct proc {
+	pgdir_entry_t *pgdir;  // Top-level page table, NULL if not seen yet
+	unsigned resident;     // Frames holding the process's pages
+	int hit_count;
+	int miss_count;
+	int evict_count;       // Its pages evicted
+	int stolen_count;      // ...of those, to make room for another process
+};
+
+/* All of the state for one simulation: (simulated) physical memory, the
+ * coremap, the page directory, swap, the replacement algorithm and the
+ * event counters.
+ *
+ * The code works on whichever simulation the thread-local 'sim' points to,
+ * so several simulations can run at once on different threads.
+ */
+struct sim {
+	unsigned memsize;
+	struct trace *trace;
+
+	/* We simulate physical memory with a large array of bytes */
+	char *physmem;
+	struct frame *coremap;
+
+	// Processes by PID, and the shift and number of index bits of each
+	// level of page table, from the top down
+	struct proc *procs;
+	unsigned procs_size;  // Entries allocated in procs
+	unsigned num_procs;   // Processes seen so far
+	unsigned pt_shift[PT_MAX_LEVELS];
+	unsigned pt_bits[PT_MAX_LEVELS];
+
+	// Stack of frames that are not in use (see allocate_frame())
+	unsigned *free_frames;
+	unsigned num_free;
+	unsigned *reclaim_victims; // Victims of one reclaim_frames()
+	unsigned *reclaim_dirty; // ...and those of them that are dirty
+	unsigned num_dirty; // Frames holding a dirty page
+
+	struct swap *swap;
+	struct tlb *tlb;  // NULL if the TLB is disabled
+	struct readahead *ra; // NULL if readahead is disabled
+	struct cleaner *cleaner; // NULL if the page cleaner is disabled
+	struct cpus *cpus; // NULL unless several CPUs are replaying the trace
+	struct huge *huge; // NULL if huge pages are disabled
+
+	struct functions alg;
+	void *alg_data;  // Private state of the replacement algorithm
+
+	// Address being brought in when the replacement algorithm's evict
+	// function is called
+	addr_t fault_vaddr;
+
+	// Counters for various events
+	int hit_count;
+	int miss_count;
+	int ref_count;
+	int evict_clean_count;
+	int evict_dirty_count;
+	int tlb_hit_count;
+	int tlb_miss_count;
+
+	// Misses on pages the replacement algorithm still remembers after
+	// evicting them (e.g. ARC's B1 and B2 or 2Q's A1out), split by whether
+	// the page had been used once or more than once
+	int ghost_recent_hit_count;
+	int ghost_frequent_hit_count;
+
+	// Dirty pages written to swap while still in memory (see clean_frame()),
+	// how many of those were later evicted clean (a write moved off the
+	// fault path) and how many were written to again first, and the
+	// number of page cleaner runs
+	int clean_write_count;
+	int clean_saved_count;
+	int clean_redirty_count;
+	int cleaner_run_count;
+
+	// Readahead: pages read in ahead of use, those later referenced,
+	// those evicted without being referenced, and evictions made to
+	// find frames for them
+	int prefetch_count;
+	int prefetch_hit_count;
+	int prefetch_wasted_count;
+	int prefetch_evict_count;
+
+	// Calls to reclaim_frames(), and the vectored writes of dirty pages to
+	// consecutive swap slots and the pages they wrote. Runs that go to the
+	// compressed pool or the writeback queue are not vectored writes.
+	int reclaim_count;
+	int cluster_write_count;
+	int cluster_page_count;
+
+	// Huge pages: promotions, base pages brought in to complete them,
+	// demotions and reservations given up under memory pressure. Page
+	// table walks, those that stopped at a huge page's directory entry
+	// (one level short), and TLB hits on huge pages (walks avoided
+	// altogether)
+	int huge_promote_count;
+	int huge_fill_count;
+	int huge_demote_count;
+	int huge_break_count;
+	int walk_count;
+	int huge_walk_count;
+	int tlb_huge_hit_count;
+
+	double replay_time; // Seconds spent replaying the trace
 };
 
-extern void (*init_fcn)(void);
-extern void (*ref_fcn)(pgtbl_entry_t *);
-extern int (*evict_fcn)(void);
+extern __thread struct sim *sim;
+
+void access_page(char *memptr, char type, addr_t vaddr);
+
+struct sim *sim_create(unsigned memsize, unsigned swapsize,
+                       struct functions *alg, struct trace *trace);
+void sim_run(struct sim *s);
+void sim_destroy(struct sim *s);
+
+void cpu_run(struct sim *s);
+void cpu_print_stats(struct sim *s);
+
+void mrc_run(struct trace *t, unsigned maxmem);
+void sweep_run(struct trace *t, struct functions **algs, int nalgs,
+               unsigned *sizes, int nsizes, unsigned swapsize, int nthreads);
 
 #endif // __SIM_H__
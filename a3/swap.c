@@ -15,29 +15,56 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
 #include "pagetable.h"
 #include "sim.h"
+#include "vpmap.h"
+#include "zswap.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024  // Linux's limit on the iovecs in one pwritev
+#endif
 
 //---------------------------------------------------------------------
 // Bitmap definitions and functions to manage space in swapfile.
-// We create a fixed-size swapfile, although it could be made larger
-// on demand with a little effort.
+// The swapfile starts at the requested size and is made larger on demand
+// when the bitmap runs out of free slots.
 //
-// The bitmap code is modified from the OS/161 bitmap functions.
+// The bitmap code is modified from the OS/161 bitmap functions. Free bits
+// are found a 64-bit word at a time with count-trailing-zeros, starting
+// from the word of the previous allocation (next fit) rather than from the
+// beginning of the map every time.
 
-#define BITS_PER_WORD 32 // Assumes sizeof(unsigned) = 4 bytes, 32 bits
-#define WORD_ALLBITS  (0xffffffff)
+#define BITS_PER_WORD 64
+#define WORD_ALLBITS  (~(uint64_t)0)
 
 #define DIVROUNDUP(a, b) (((a) + (b) -1) / (b))
 
 struct bitmap {
 	unsigned nbits;
-	unsigned *v;
+	unsigned cursor;  // Word to start the next search from
+	uint64_t *v;
 };
 
+/* Marks the leftover bits past nbits in the last word in use, so that they
+ * are never allocated.
+ */
+static void bitmap_mark_tail(struct bitmap *b)
+{
+	unsigned overbits = b->nbits % BITS_PER_WORD;
+	if (overbits > 0) {
+		b->v[b->nbits / BITS_PER_WORD] |= WORD_ALLBITS << overbits;
+	}
+}
+
 static struct bitmap *bitmap_create(unsigned nbits)
 {
 	unsigned words = DIVROUNDUP(nbits, BITS_PER_WORD);
@@ -45,53 +72,123 @@ static struct bitmap *bitmap_create(unsigned nbits)
 	if (b == NULL) {
 		return NULL;
 	}
-	b->v = malloc(words*sizeof(unsigned));
+	b->v = calloc(words, sizeof(uint64_t));
 	if (b->v == NULL) {
 		free(b);
 		return NULL;
 	}
 
-	memset(b->v, 0, words*sizeof(unsigned));
 	b->nbits = nbits;
+	b->cursor = 0;
 
 	/* Mark any leftover bits at the end in use */
-	if (words > nbits / BITS_PER_WORD) {
-		unsigned ix = words - 1;
-		unsigned overbits = nbits - ix * BITS_PER_WORD;
+	bitmap_mark_tail(b);
+
+	return b;
+}
 
-		assert(nbits / BITS_PER_WORD == words - 1);
-		assert(overbits > 0 && overbits < BITS_PER_WORD);
+/* Extends the bitmap to nbits bits. The new bits are all free.
+ * Returns 0 on success, or 1 if memory could not be allocated.
+ */
+static int bitmap_grow(struct bitmap *b, unsigned nbits)
+{
+	unsigned oldwords = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+	unsigned words = DIVROUNDUP(nbits, BITS_PER_WORD);
+	assert(nbits > b->nbits);
 
-		for (unsigned j = overbits; j < BITS_PER_WORD; j++) {
-			b->v[ix] |= ((unsigned)1 << j);
-		}
+	uint64_t *v = realloc(b->v, words * sizeof(uint64_t));
+	if (v == NULL) {
+		return 1;
 	}
+	memset(v + oldwords, 0, (words - oldwords) * sizeof(uint64_t));
 
-	return b;
+	// Free the leftover bits of the old last word, then mark the new ones
+	unsigned overbits = b->nbits % BITS_PER_WORD;
+	if (overbits > 0) {
+		v[oldwords - 1] &= ~(WORD_ALLBITS << overbits);
+	}
+	b->v = v;
+	b->nbits = nbits;
+	bitmap_mark_tail(b);
+
+	// The first free bits are where the map was extended
+	b->cursor = oldwords - (overbits > 0);
+	return 0;
 }
 
 static int bitmap_alloc(struct bitmap *b, unsigned *index)
 {
 	unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+	unsigned ix = b->cursor;
 
-	for (unsigned ix = 0; ix < maxix; ix++) {
+	for (unsigned n = 0; n < maxix; n++) {
 		if (b->v[ix] != WORD_ALLBITS) {
-			for (unsigned offset = 0; offset < BITS_PER_WORD; offset++) {
-				unsigned mask = ((unsigned)1) << offset;
-
-				if ((b->v[ix] & mask) == 0) {
-					b->v[ix] |= mask;
-					*index = (ix * BITS_PER_WORD) + offset;
-					assert(*index < b->nbits);
-					return 0;
-				}
-			}
-			assert(0);
+			unsigned offset = __builtin_ctzll(~b->v[ix]);
+			b->v[ix] |= (uint64_t)1 << offset;
+			*index = (ix * BITS_PER_WORD) + offset;
+			assert(*index < b->nbits);
+			b->cursor = ix;
+			return 0;
+		}
+		if (++ix == maxix) {
+			ix = 0;
 		}
 	}
 	return 1;
 }
 
+/* Finds and marks a run of n free bits, searching from the cursor to the end
+ * of the map and then from the beginning. Full words are skipped whole.
+ * Returns 0 on success, or 1 if there is no run that long.
+ */
+static int bitmap_alloc_run(struct bitmap *b, unsigned n, unsigned *index)
+{
+	unsigned start = b->cursor * BITS_PER_WORD;
+	unsigned limit = b->nbits;
+	unsigned run = 0;
+
+	for (unsigned i = start; ; ) {
+		if (i == limit) {
+			if (start == 0) {
+				return 1;
+			}
+			// Wrap around; a run may end just past where we started
+			limit = start + n - 1 < b->nbits ? start + n - 1 : b->nbits;
+			i = start = run = 0;
+			continue;
+		}
+		uint64_t word = b->v[i / BITS_PER_WORD];
+		if (i % BITS_PER_WORD == 0 && word == WORD_ALLBITS) {
+			run = 0;
+			i += BITS_PER_WORD;
+			if (i > limit) {
+				i = limit;
+			}
+			continue;
+		}
+		if (word & ((uint64_t)1 << (i % BITS_PER_WORD))) {
+			run = 0;
+		} else if (++run == n) {
+			*index = i + 1 - n;
+			for (unsigned j = *index; j <= i; j++) {
+				b->v[j / BITS_PER_WORD] |= (uint64_t)1 << (j % BITS_PER_WORD);
+			}
+			b->cursor = i / BITS_PER_WORD;
+			return 0;
+		}
+		i++;
+	}
+}
+
+static void bitmap_unmark(struct bitmap *b, unsigned index)
+{
+	uint64_t mask = (uint64_t)1 << (index % BITS_PER_WORD);
+
+	assert(index < b->nbits);
+	assert(b->v[index / BITS_PER_WORD] & mask);
+	b->v[index / BITS_PER_WORD] &= ~mask;
+}
+
 static void bitmap_destroy(struct bitmap *b)
 {
 	free(b->v);
@@ -101,37 +198,467 @@ static void bitmap_destroy(struct bitmap *b)
 //---------------------------------------------------------------------
 // Swap definitions and functions.
 
-static int swapfd;
-static struct bitmap *swapmap;
-static char *fname;
+// Each simulation has its own swap area, in sim->swap.
+struct swap {
+	struct swap_backend *backend;
+	struct bitmap *swapmap;
+	int swapfd;
+	char fname[20];
+	char *area;       // Mapped swapfile or in-memory swap area
+	size_t area_len;
+	unsigned swapsize; // Number of pages the swap area can hold
+	struct writeback *wb; // Writeback queue, or NULL to write synchronously
+	struct zswap *zswap;  // Compressed pool in front of the swap area, or NULL
+};
 
-int swap_init(unsigned swapsize)
+//---------------------------------------------------------------------
+// Swap backends.
+// Each backend reads and writes SIMPAGESIZE-byte pages at byte offsets in
+// the swap area. read and write return the number of bytes transferred, or
+// -1 with errno set. writev writes pages from several buffers to
+// consecutive slots starting at offset. grow makes room for swap->swapsize
+// pages. The backend is chosen with swap_backend (sim -b).
+
+struct swap_backend {
+	char *name;
+	void (*init)(struct swap *swap, unsigned swapsize);
+	void (*destroy)(struct swap *swap);
+	void (*grow)(struct swap *swap);
+	ssize_t (*read)(struct swap *swap, void *buf, off_t offset);
+	ssize_t (*write)(struct swap *swap, const void *buf, off_t offset);
+	ssize_t (*writev)(struct swap *swap, const struct iovec *iov, int n,
+	                  off_t offset);
+};
+
+char *swap_backend = "file";
+
+static void swapfile_create(struct swap *swap)
 {
-	// Initialize the swap file
-	fname = malloc(20);
-	strncpy(fname, "swapfile.XXXXXX",20);
-	if ((swapfd = mkstemp(fname)) == -1) {
+	strncpy(swap->fname, "swapfile.XXXXXX", sizeof(swap->fname));
+	if ((swap->swapfd = mkstemp(swap->fname)) == -1) {
 		perror("Failed to create temporary file for swap");
 		exit(1);
 	}
+}
+
+static void swapfile_remove(struct swap *swap)
+{
+	close(swap->swapfd);
+	unlink(swap->fname);
+}
+
+// "file": the swapfile is accessed with one positional read or write
+// (pread/pwrite) per page, instead of a seek followed by a read or write.
+// A cluster of pages is written with a single pwritev.
+static void file_init(struct swap *swap, unsigned swapsize)
+{
+	(void)swapsize;
+	swapfile_create(swap);
+}
+
+// The swapfile grows by itself as pages are written past its end
+static void file_grow(struct swap *swap)
+{
+	(void)swap;
+}
+
+static ssize_t file_read(struct swap *swap, void *buf, off_t offset)
+{
+	return pread(swap->swapfd, buf, SIMPAGESIZE, offset);
+}
+
+static ssize_t file_write(struct swap *swap, const void *buf, off_t offset)
+{
+	return pwrite(swap->swapfd, buf, SIMPAGESIZE, offset);
+}
+
+static ssize_t file_writev(struct swap *swap, const struct iovec *iov, int n,
+                           off_t offset)
+{
+	return pwritev(swap->swapfd, iov, n, offset);
+}
+
+// "mmap": the swapfile is sized up front and mapped, so pages are copied
+// to and from it with no system calls at all.
+static void mmap_init_area(struct swap *swap)
+{
+	swap->area_len = (size_t)swap->swapsize * SIMPAGESIZE;
+	if (ftruncate(swap->swapfd, swap->area_len) == -1) {
+		perror("Failed to size swapfile");
+		exit(1);
+	}
+	swap->area = mmap(NULL, swap->area_len, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED, swap->swapfd, 0);
+	if (swap->area == MAP_FAILED) {
+		perror("Failed to map swapfile");
+		exit(1);
+	}
+}
+
+static void mmap_init(struct swap *swap, unsigned swapsize)
+{
+	(void)swapsize;
+	swapfile_create(swap);
+	mmap_init_area(swap);
+}
+
+static void mmap_grow(struct swap *swap)
+{
+	munmap(swap->area, swap->area_len);
+	mmap_init_area(swap);
+}
+
+static void mmap_destroy(struct swap *swap)
+{
+	munmap(swap->area, swap->area_len);
+	swapfile_remove(swap);
+}
+
+// "mem": swap is an ordinary array in memory and there is no swapfile.
+static void mem_init(struct swap *swap, unsigned swapsize)
+{
+	swap->swapfd = -1;
+	swap->area_len = (size_t)swapsize * SIMPAGESIZE;
+	if ((swap->area = malloc(swap->area_len)) == NULL) {
+		perror("Failed to allocate swap area");
+		exit(1);
+	}
+}
+
+static void mem_grow(struct swap *swap)
+{
+	swap->area_len = (size_t)swap->swapsize * SIMPAGESIZE;
+	if ((swap->area = realloc(swap->area, swap->area_len)) == NULL) {
+		perror("Failed to grow swap area");
+		exit(1);
+	}
+}
+
+static void mem_destroy(struct swap *swap)
+{
+	free(swap->area);
+}
+
+static ssize_t area_read(struct swap *swap, void *buf, off_t offset)
+{
+	if ((size_t)offset + SIMPAGESIZE > swap->area_len) {
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(buf, swap->area + offset, SIMPAGESIZE);
+	return SIMPAGESIZE;
+}
+
+static ssize_t area_write(struct swap *swap, const void *buf, off_t offset)
+{
+	if ((size_t)offset + SIMPAGESIZE > swap->area_len) {
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(swap->area + offset, buf, SIMPAGESIZE);
+	return SIMPAGESIZE;
+}
+
+static ssize_t area_writev(struct swap *swap, const struct iovec *iov, int n,
+                           off_t offset)
+{
+	if ((size_t)offset + (size_t)n * SIMPAGESIZE > swap->area_len) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (int i = 0; i < n; i++) {
+		memcpy(swap->area + offset + (size_t)i * SIMPAGESIZE,
+		       iov[i].iov_base, SIMPAGESIZE);
+	}
+	return (ssize_t)n * SIMPAGESIZE;
+}
+
+static struct swap_backend backends[] = {
+	{"file", file_init, swapfile_remove, file_grow, file_read, file_write, file_writev},
+	{"mmap", mmap_init, mmap_destroy, mmap_grow, area_read, area_write, area_writev},
+	{"mem", mem_init, mem_destroy, mem_grow, area_read, area_write, area_writev},
+};
+static int num_backends = 3;
+
+//---------------------------------------------------------------------
+// Asynchronous writeback.
+// With writeback_depth > 0 (sim -w), swap_pageout() copies the page into a
+// bounded queue and returns at once; a background I/O thread writes the
+// queued pages to the backend in batches. A swap_pagein() for a page whose
+// write is still queued or in progress is served from the queued copy.
+// The queue is drained before the swap area grows and at swap_flush().
+
+#define WB_BATCH 32
+
+unsigned writeback_depth = 0;
+
+struct wb_entry {
+	int swap_offset;
+	char data[SIMPAGESIZE];
+};
+
+struct writeback {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	int done;
+
+	// Ring of queued pages. Entries head..tail-1 (mod depth) are waiting
+	// or being written; head only advances once an entry is on disk.
+	struct wb_entry *ring;
+	unsigned long head;
+	unsigned long tail;
+
+	// Swap slot number -> ring position of the latest write to it
+	struct vpmap *inflight;
+
+	// Statistics
+	unsigned long pages;
+	unsigned long batches;
+	unsigned long stalls;      // Evictions that waited for a full queue
+	unsigned long inflight_hits;
+	double fg_time;            // Time swap_pageout() spent queueing
+	double bg_time;            // Time the I/O thread spent writing
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *wb_thread(void *arg)
+{
+	struct swap *swap = arg;
+	struct writeback *wb = swap->wb;
+
+	pthread_mutex_lock(&wb->lock);
+	for (;;) {
+		while (wb->head == wb->tail && !wb->done) {
+			pthread_cond_wait(&wb->not_empty, &wb->lock);
+		}
+		if (wb->head == wb->tail) {
+			break;
+		}
+		unsigned long start = wb->head;
+		unsigned long end = wb->tail - start > WB_BATCH ? start + WB_BATCH : wb->tail;
+		pthread_mutex_unlock(&wb->lock);
+
+		// Entries in [start, end) are not touched by the foreground
+		// until head moves past them, so they can be written unlocked.
+		double t = now();
+		for (unsigned long i = start; i < end; i++) {
+			struct wb_entry *e = &wb->ring[i % writeback_depth];
+			if (swap->backend->write(swap, e->data, e->swap_offset) != SIMPAGESIZE) {
+				perror("swap writeback: failed to write page");
+				exit(1);
+			}
+		}
+		t = now() - t;
+
+		pthread_mutex_lock(&wb->lock);
+		for (unsigned long i = start; i < end; i++) {
+			struct wb_entry *e = &wb->ring[i % writeback_depth];
+			long pos;
+			// Only forget the slot if no later write to it is queued
+			if (vpmap_get(wb->inflight, e->swap_offset / SIMPAGESIZE, &pos) &&
+			    (unsigned long)pos == i) {
+				vpmap_remove(wb->inflight, e->swap_offset / SIMPAGESIZE);
+			}
+		}
+		wb->head = end;
+		wb->batches++;
+		wb->bg_time += t;
+		pthread_cond_broadcast(&wb->not_full);
+	}
+	pthread_mutex_unlock(&wb->lock);
+	return NULL;
+}
+
+static void wb_init(struct swap *swap)
+{
+	struct writeback *wb = calloc(1, sizeof(struct writeback));
+	if (wb == NULL ||
+	    (wb->ring = malloc(writeback_depth * sizeof(struct wb_entry))) == NULL) {
+		perror("Failed to allocate writeback queue");
+		exit(1);
+	}
+	wb->inflight = vpmap_create(writeback_depth);
+	pthread_mutex_init(&wb->lock, NULL);
+	pthread_cond_init(&wb->not_empty, NULL);
+	pthread_cond_init(&wb->not_full, NULL);
+	swap->wb = wb;
+
+	if (pthread_create(&wb->thread, NULL, wb_thread, swap) != 0) {
+		fprintf(stderr, "Failed to start writeback thread\n");
+		exit(1);
+	}
+}
+
+// Queues a copy of buf to be written at swap_offset.
+static void wb_queue(struct writeback *wb, const void *buf, int swap_offset)
+{
+	double t = now();
+
+	pthread_mutex_lock(&wb->lock);
+	if (wb->tail - wb->head == writeback_depth) {
+		wb->stalls++;
+		do {
+			pthread_cond_wait(&wb->not_full, &wb->lock);
+		} while (wb->tail - wb->head == writeback_depth);
+	}
+	struct wb_entry *e = &wb->ring[wb->tail % writeback_depth];
+	e->swap_offset = swap_offset;
+	memcpy(e->data, buf, SIMPAGESIZE);
+	vpmap_put(wb->inflight, swap_offset / SIMPAGESIZE, wb->tail);
+	wb->tail++;
+	wb->pages++;
+	pthread_cond_signal(&wb->not_empty);
+	pthread_mutex_unlock(&wb->lock);
+
+	wb->fg_time += now() - t;
+}
+
+// Copies the queued data for swap_offset into buf, if a write to it is
+// still pending. Returns 1 if it was, 0 if the backend has the latest copy.
+static int wb_lookup(struct writeback *wb, void *buf, int swap_offset)
+{
+	long pos;
+	int found;
+
+	pthread_mutex_lock(&wb->lock);
+	found = vpmap_get(wb->inflight, swap_offset / SIMPAGESIZE, &pos);
+	if (found) {
+		memcpy(buf, wb->ring[pos % writeback_depth].data, SIMPAGESIZE);
+		wb->inflight_hits++;
+	}
+	pthread_mutex_unlock(&wb->lock);
+	return found;
+}
+
+// Waits until every queued page has been written.
+static void wb_drain(struct writeback *wb)
+{
+	double t = now();
+
+	pthread_mutex_lock(&wb->lock);
+	while (wb->head != wb->tail) {
+		pthread_cond_wait(&wb->not_full, &wb->lock);
+	}
+	pthread_mutex_unlock(&wb->lock);
+
+	wb->fg_time += now() - t;
+}
+
+static void wb_destroy(struct writeback *wb)
+{
+	pthread_mutex_lock(&wb->lock);
+	wb->done = 1;
+	pthread_cond_signal(&wb->not_empty);
+	pthread_mutex_unlock(&wb->lock);
+	pthread_join(wb->thread, NULL);
+
+	pthread_mutex_destroy(&wb->lock);
+	pthread_cond_destroy(&wb->not_empty);
+	pthread_cond_destroy(&wb->not_full);
+	vpmap_destroy(wb->inflight);
+	free(wb->ring);
+	free(wb);
+}
+
+/* Waits for all queued writeback to reach the swap area. */
+void swap_flush(void)
+{
+	if (sim->swap->wb) {
+		wb_drain(sim->swap->wb);
+	}
+}
+
+/* Prints the statistics of the compressed pool and of writeback, if they
+ * are enabled.
+ */
+void swap_print_stats(void)
+{
+	struct writeback *wb = sim->swap->wb;
+	if (sim->swap->zswap) {
+		zswap_print_stats(sim->swap->zswap);
+	}
+	if (wb == NULL) {
+		return;
+	}
+	printf("Writeback pages: %lu in %lu batches\n", wb->pages, wb->batches);
+	printf("Writeback stalls: %lu\n", wb->stalls);
+	printf("Writeback page-ins from queue: %lu\n", wb->inflight_hits);
+	printf("Foreground pageout time: %.4f s\n", wb->fg_time);
+	printf("Background write time: %.4f s\n", wb->bg_time);
+	printf("Foreground time saved: %.4f s\n", wb->bg_time - wb->fg_time);
+}
+
+//---------------------------------------------------------------------
+
+int swap_init(unsigned swapsize)
+{
+	struct swap *swap = calloc(1, sizeof(struct swap));
+	if (swap == NULL) {
+		perror("Failed to allocate swap");
+		exit(1);
+	}
+
+	for (int i = 0; i < num_backends; i++) {
+		if (strcmp(backends[i].name, swap_backend) == 0) {
+			swap->backend = &backends[i];
+			break;
+		}
+	}
+	if (swap->backend == NULL) {
+		fprintf(stderr, "Error: invalid swap backend - %s\n", swap_backend);
+		exit(1);
+	}
+
+	// Initialize the swap file (or memory)
+	swap->swapsize = swapsize;
+	swap->backend->init(swap, swapsize);
 
 	// Initialize the bitmap
-	if ((swapmap = bitmap_create(swapsize)) == NULL) {
+	if ((swap->swapmap = bitmap_create(swapsize)) == NULL) {
 		fprintf(stderr,"Failed to create bitmap for swap\n");
 		exit(1);
 	}
 
+	if (writeback_depth > 0) {
+		wb_init(swap);
+	}
+	if (zswap_percent > 0) {
+		swap->zswap = zswap_create((size_t)sim->memsize * SIMPAGESIZE *
+		                           zswap_percent / 100);
+	}
+
+	sim->swap = swap;
 	return 0;
 }
 
 void swap_destroy()
 {
+	struct swap *swap = sim->swap;
+
+	// Finish any queued writes before the swap area goes away
+	if (swap->wb) {
+		wb_destroy(swap->wb);
+	}
+
+	if (swap->zswap) {
+		zswap_destroy(swap->zswap);
+	}
+
 	// Close and remove swapfile
-	close(swapfd);
-	unlink(fname);
+	swap->backend->destroy(swap);
 
 	// Destroy bitmap
-	bitmap_destroy(swapmap);
+	bitmap_destroy(swap->swapmap);
+	free(swap);
+	sim->swap = NULL;
 }
 
 // Read data into (simulated) physical memory 'frame' from 'swap_offset'
@@ -144,20 +671,28 @@ void swap_destroy()
 int swap_pagein(unsigned frame, int swap_offset)
 {
 	assert(swap_offset != INVALID_SWAP);
+	struct swap *swap = sim->swap;
 
 	// Get pointer to page data in (simulated) physical memory
-	char *frame_ptr = &physmem[frame * SIMPAGESIZE];
+	char *frame_ptr = &sim->physmem[frame * SIMPAGESIZE];
 
-	// Seek to position in swap file where this page was stored
-	off_t pos = lseek(swapfd, swap_offset, SEEK_SET);
-	if (pos != swap_offset) {
-		assert(pos == (off_t)-1);
-		perror("swap_pagein: failed to set read position");
-		return -errno;
+	// A page in the compressed pool is decompressed from there
+	if (swap->zswap &&
+	    zswap_load(swap->zswap, swap_offset / SIMPAGESIZE, frame_ptr)) {
+		return 0;
+	}
+
+	// A page whose write is still queued is copied from the queue
+	if (swap->wb && wb_lookup(swap->wb, frame_ptr, swap_offset)) {
+		return 0;
 	}
 
 	// Read page data from swapfile into memory
-	ssize_t bytes_read = read(swapfd, frame_ptr, SIMPAGESIZE);
+	ssize_t bytes_read = swap->backend->read(swap, frame_ptr, swap_offset);
+	if (bytes_read == -1) {
+		perror("swap_pagein: failed to read page");
+		return -errno;
+	}
 	if (bytes_read != SIMPAGESIZE) {
 		fprintf(stderr, "swap_pagein: did not read whole page\n");
 		return bytes_read;
@@ -165,6 +700,47 @@ int swap_pagein(unsigned frame, int swap_offset)
 	return 0;
 }
 
+// Writes the page in buf to 'swap_offset' in the swap area, through the
+// writeback queue if there is one. Returns 0 on success, -1 on failure.
+static int write_page(struct swap *swap, const void *buf, int swap_offset)
+{
+	if (swap->wb) {
+		wb_queue(swap->wb, buf, swap_offset);
+		return 0;
+	}
+
+	// Write page data from memory to swapfile
+	ssize_t bytes_written = swap->backend->write(swap, buf, swap_offset);
+	if (bytes_written != SIMPAGESIZE) {
+		if (bytes_written == -1) {
+			perror("swap_pageout: failed to write page");
+		} else {
+			fprintf(stderr,"swap_pageout: did not write whole page\n");
+		}
+		return -1;
+	}
+	return 0;
+}
+
+// Stores the page in buf in the compressed pool under 'swap_offset',
+// writing the pool's oldest pages back to their slots while it is full.
+// Returns 1 if the page was stored, or 0 if it must be written to the swap
+// area itself (it does not compress, or is too big for the pool).
+static int zswap_pageout(struct swap *swap, const void *buf, int swap_offset)
+{
+	char page[SIMPAGESIZE];
+	unsigned slot;
+	int ret;
+
+	while ((ret = zswap_store(swap->zswap, swap_offset / SIMPAGESIZE, buf)) == 1 &&
+	       zswap_evict(swap->zswap, page, &slot)) {
+		if (write_page(swap, page, slot * SIMPAGESIZE) != 0) {
+			exit(1);
+		}
+	}
+	return ret == 0;
+}
+
 // Write data from (simulated) physical memory 'frame' to 'swap_offset'
 // in swap file. Allocates space in swap file for virtual page if needed.
 // Input:  frame - the physical frame number (not byte offset in physmem)
@@ -174,33 +750,129 @@ int swap_pagein(unsigned frame, int swap_offset)
 // 
 int swap_pageout(unsigned frame, int swap_offset)
 {
+	struct swap *swap = sim->swap;
+
 	// Check if swap has already been allocated for this page 
 	if (swap_offset == INVALID_SWAP) {
 		unsigned idx;
-		if (bitmap_alloc(swapmap, &idx) != 0) {
-			fprintf(stderr, "swap_pageout: Could not allocate space in swapfile. Try running again with a larger swapsize.\n");
-			return INVALID_SWAP;
+		if (bitmap_alloc(swap->swapmap, &idx) != 0) {
+			// Out of slots: double the size of the swap area
+			unsigned newsize = swap->swapsize ? 2 * swap->swapsize : 64;
+			if ((size_t)newsize * SIMPAGESIZE > INT_MAX ||
+			    bitmap_grow(swap->swapmap, newsize) != 0) {
+				fprintf(stderr, "swap_pageout: Could not grow swapfile.\n");
+				return INVALID_SWAP;
+			}
+			swap->swapsize = newsize;
+			if (swap->wb) {
+				wb_drain(swap->wb); // no writes while the area moves
+			}
+			swap->backend->grow(swap);
+			int error = bitmap_alloc(swap->swapmap, &idx);
+			assert(error == 0);
 		}
 		swap_offset = idx * SIMPAGESIZE;
 	}
 	assert(swap_offset != INVALID_SWAP);
 
 	// Get pointer to page data in (simulated) physical memory
-	void *frame_ptr = &physmem[frame * SIMPAGESIZE];
+	void *frame_ptr = &sim->physmem[frame * SIMPAGESIZE];
 
-	// Seek to position in swap file where this page will be stored
-	off_t pos = lseek(swapfd, swap_offset, SEEK_SET);
-	if (pos != swap_offset) {
-		assert(pos == (off_t)-1);
-		perror("swap_pageout: failed to set write position");
+	if (swap->zswap && zswap_pageout(swap, frame_ptr, swap_offset)) {
+		return swap_offset;
+	}
+	if (write_page(swap, frame_ptr, swap_offset) != 0) {
 		return INVALID_SWAP;
 	}
+	return swap_offset;
+}
 
-	// Read page data from swapfile into memory
-	ssize_t bytes_written = write(swapfd, frame_ptr, SIMPAGESIZE);
-	if (bytes_written != SIMPAGESIZE) {
-		fprintf(stderr,"swap_pageout: did not write whole page\n");
+// Release the space in the swap file at 'swap_offset', when the page
+// stored there is discarded or the copy there is no longer needed.
+// Input:  swap_offset - the byte position in the swap file.
+//
+void swap_free(int swap_offset)
+{
+	assert(swap_offset != INVALID_SWAP);
+	if (sim->swap->zswap) {
+		zswap_invalidate(sim->swap->zswap, swap_offset / SIMPAGESIZE);
+	}
+	bitmap_unmark(sim->swap->swapmap, swap_offset / SIMPAGESIZE);
+}
+
+// Frees the n slots from idx, and any of their pages in the compressed pool,
+// when a clustered write fails. The caller writes the pages one at a time
+// instead, to slots of their own.
+static void release_run(struct swap *swap, unsigned idx, int n)
+{
+	for (int i = 0; i < n; i++) {
+		if (swap->zswap) {
+			zswap_invalidate(swap->zswap, idx + i);
+		}
+		bitmap_unmark(swap->swapmap, idx + i);
+	}
+}
+
+// Write the pages in the n (simulated) physical memory 'frames' to n
+// consecutive free slots in the swap file, with one vectored write. The
+// pages must not have slots already.
+// Input:  frames - the physical frame numbers of the pages
+// Return: the swap_offset of the first page, the others following it, or
+//         INVALID_SWAP if there is no free run of n slots or the write fails
+//
+int swap_pageout_cluster(const unsigned *frames, int n)
+{
+	struct swap *swap = sim->swap;
+	unsigned idx;
+
+	if (bitmap_alloc_run(swap->swapmap, n, &idx) != 0) {
 		return INVALID_SWAP;
 	}
+	int swap_offset = idx * SIMPAGESIZE;
+
+	// Pages that go to the compressed pool need no write, and the
+	// writeback thread batches the queued pages by itself
+	if (swap->zswap) {
+		for (int i = 0; i < n; i++) {
+			void *buf = &sim->physmem[frames[i] * SIMPAGESIZE];
+			int off = swap_offset + i * SIMPAGESIZE;
+			if (!zswap_pageout(swap, buf, off) && write_page(swap, buf, off) != 0) {
+				release_run(swap, idx, n);
+				return INVALID_SWAP;
+			}
+		}
+		return swap_offset;
+	}
+	if (swap->wb) {
+		for (int i = 0; i < n; i++) {
+			wb_queue(swap->wb, &sim->physmem[frames[i] * SIMPAGESIZE],
+			         swap_offset + i * SIMPAGESIZE);
+		}
+		return swap_offset;
+	}
+
+	// Written IOV_MAX pages at a time at most
+	struct iovec iov[n < IOV_MAX ? n : IOV_MAX];
+	for (int done = 0; done < n; ) {
+		int count = n - done < IOV_MAX ? n - done : IOV_MAX;
+		for (int i = 0; i < count; i++) {
+			iov[i].iov_base = &sim->physmem[frames[done + i] * SIMPAGESIZE];
+			iov[i].iov_len = SIMPAGESIZE;
+		}
+		ssize_t bytes_written = swap->backend->writev(swap, iov, count,
+		                                swap_offset + done * SIMPAGESIZE);
+		if (bytes_written != (ssize_t)count * SIMPAGESIZE) {
+			if (bytes_written == -1) {
+				perror("swap_pageout_cluster: failed to write pages");
+			} else {
+				fprintf(stderr, "swap_pageout_cluster: did not write all pages\n");
+			}
+			release_run(swap, idx, n);
+			return INVALID_SWAP;
+		}
+		sim->cluster_write_count++;
+		sim->cluster_page_count += count;
+		done += count;
+	}
 	return swap_offset;
 }
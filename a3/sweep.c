@@ -0,0 +1,248 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Sweep mode: simulate every (algorithm, memory size) combination for one
+ * trace and print a single table of the results.
+ *
+ * The trace is read into memory (or mapped) once and shared by every
+ * simulation. The simulations run on a pool of worker threads. Each worker
+ * has its own queue of jobs and takes work from the back of it; a worker
+ * whose queue is empty steals from the front of another worker's queue, so
+ * long runs (OPT, large memory sizes) do not leave the other threads idle.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+#include "trace.h"
+
+struct job {
+	struct functions *alg;
+	unsigned memsize;
+
+	// Results, filled in when the job has run
+	int hit_count;
+	int miss_count;
+	int ref_count;
+	int evict_clean_count;
+	int evict_dirty_count;
+};
+
+// A worker's queue of job numbers. The owner takes from the back (tail),
+// thieves take from the front (head).
+struct job_queue {
+	pthread_mutex_t lock;
+	int *jobs;
+	int head;
+	int tail;
+};
+
+struct pool {
+	struct job *jobs;
+	struct job_queue *queues;
+	int nworkers;
+	struct trace *trace;
+	unsigned swapsize;
+};
+
+struct worker {
+	struct pool *pool;
+	int id;
+};
+
+static int take_back(struct job_queue *q)
+{
+	int job = -1;
+	pthread_mutex_lock(&q->lock);
+	if (q->head < q->tail) {
+		job = q->jobs[--q->tail];
+	}
+	pthread_mutex_unlock(&q->lock);
+	return job;
+}
+
+static int take_front(struct job_queue *q)
+{
+	int job = -1;
+	pthread_mutex_lock(&q->lock);
+	if (q->head < q->tail) {
+		job = q->jobs[q->head++];
+	}
+	pthread_mutex_unlock(&q->lock);
+	return job;
+}
+
+// Returns the next job for worker id, or -1 once every queue is empty.
+// No jobs are added after the sweep starts, so one empty pass means done.
+static int next_job(struct pool *pool, int id)
+{
+	int job = take_back(&pool->queues[id]);
+	for (int k = 1; job == -1 && k < pool->nworkers; k++) {
+		job = take_front(&pool->queues[(id + k) % pool->nworkers]);
+	}
+	return job;
+}
+
+static void run_job(struct pool *pool, struct job *job)
+{
+	// Each simulation reads the shared records through its own view
+	struct trace view;
+	trace_view(&view, pool->trace);
+
+	struct sim *s = sim_create(job->memsize, pool->swapsize, job->alg, &view);
+	sim_run(s);
+
+	job->hit_count = s->hit_count;
+	job->miss_count = s->miss_count;
+	job->ref_count = s->ref_count;
+	job->evict_clean_count = s->evict_clean_count;
+	job->evict_dirty_count = s->evict_dirty_count;
+	sim_destroy(s);
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	int job;
+
+	while ((job = next_job(w->pool, w->id)) != -1) {
+		run_job(w->pool, &w->pool->jobs[job]);
+	}
+	return NULL;
+}
+
+static void print_results(struct job *jobs, int nalgs, int nsizes)
+{
+	const char *name = strrchr(tracefile, '/');
+	name = name ? name + 1 : tracefile;
+
+	// The algorithm column is wide enough for the longest name
+	int width = 10;
+	for (int a = 0; a < nalgs; a++) {
+		if ((int)strlen(jobs[a].alg->name) > width) {
+			width = strlen(jobs[a].alg->name);
+		}
+	}
+
+	printf("## Trace File: %s\n", name);
+	for (int m = 0; m < nsizes; m++) {
+		printf("\n### memsize=%u\n\n", jobs[m * nalgs].memsize);
+		printf("| %*s | hit rate | hit count | Miss count | Overall eviction count | Clean eviction count | Dirty eviction count |\n",
+		       width, "Algorithm");
+		printf("| :%.*s: | :------: | :-------: | :--------: | :--------------------: | :------------------: | :------------------: |\n",
+		       width - 2, "----------------");
+		for (int a = 0; a < nalgs; a++) {
+			struct job *j = &jobs[m * nalgs + a];
+			char alg[16];
+			int i;
+			for (i = 0; j->alg->name[i] && i < (int)sizeof(alg) - 1; i++) {
+				alg[i] = toupper((unsigned char)j->alg->name[i]);
+			}
+			alg[i] = '\0';
+
+			printf("| %-*s | %8.4f | %9d | %10d | %22d | %20d | %20d |\n",
+			       width, alg, (double)j->hit_count / j->ref_count * 100,
+			       j->hit_count, j->miss_count,
+			       j->evict_clean_count + j->evict_dirty_count,
+			       j->evict_clean_count, j->evict_dirty_count);
+		}
+	}
+}
+
+/* Simulates every combination of the nalgs algorithms and nsizes memory
+ * sizes on nthreads threads (0 means one per online CPU), then prints the
+ * results grouped by memory size.
+ */
+void sweep_run(struct trace *t, struct functions **algs, int nalgs,
+               unsigned *sizes, int nsizes, unsigned swapsize, int nthreads)
+{
+	// Parse a text trace once, up front, instead of once per simulation
+	if (trace_load(t) != 0) {
+		exit(1);
+	}
+
+	int njobs = nalgs * nsizes;
+	if (nthreads <= 0) {
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (nthreads > njobs) {
+		nthreads = njobs;
+	}
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+
+	struct pool pool;
+	pool.jobs = calloc(njobs, sizeof(struct job));
+	pool.queues = calloc(nthreads, sizeof(struct job_queue));
+	pool.nworkers = nthreads;
+	pool.trace = t;
+	pool.swapsize = swapsize;
+	if (pool.jobs == NULL || pool.queues == NULL) {
+		perror("sweep_run: calloc");
+		exit(1);
+	}
+
+	for (int q = 0; q < nthreads; q++) {
+		pthread_mutex_init(&pool.queues[q].lock, NULL);
+		pool.queues[q].jobs = malloc(njobs * sizeof(int));
+		if (pool.queues[q].jobs == NULL) {
+			perror("sweep_run: malloc");
+			exit(1);
+		}
+	}
+
+	// Jobs are numbered in table order and dealt out round-robin
+	for (int i = 0; i < njobs; i++) {
+		struct job_queue *q = &pool.queues[i % nthreads];
+		pool.jobs[i].alg = algs[i % nalgs];
+		pool.jobs[i].memsize = sizes[i / nalgs];
+		q->jobs[q->tail++] = i;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pthread_t threads[nthreads];
+	struct worker workers[nthreads];
+	for (int i = 0; i < nthreads; i++) {
+		workers[i].pool = &pool;
+		workers[i].id = i;
+		if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0) {
+			fprintf(stderr, "sweep_run: failed to create worker thread\n");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	print_results(pool.jobs, nalgs, nsizes);
+	fprintf(stderr, "\n%d simulations of %lu references on %d threads in %.3f s\n",
+	        njobs, (unsigned long)t->nrecs, nthreads,
+	        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+	for (int q = 0; q < nthreads; q++) {
+		pthread_mutex_destroy(&pool.queues[q].lock);
+		free(pool.queues[q].jobs);
+	}
+	free(pool.queues);
+	free(pool.jobs);
+}
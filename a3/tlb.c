@@ -0,0 +1,194 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* A simulated set-associative TLB, checked by find_physpage() before it
+ * walks the page table. Each entry caches the translation of a virtual page
+ * to its page table entry. Only pages that are in memory are cached, so the
+ * entry for a page is invalidated when the page is evicted.
+ *
+ * With huge pages, an entry can also cache a whole huge page: its key is
+ * the huge page number and it points at the first entry of the leaf table
+ * under it. Base and huge entries share the sets, as in a unified
+ * second-level TLB.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+// TLB configuration, set with sim -t entries[,ways[,lru|rand]]
+unsigned tlb_entries = 0;
+unsigned tlb_ways = 1;
+char *tlb_policy = "lru";
+
+struct tlb_entry {
+	addr_t vpage;         // Huge page number if huge is set
+	pgtbl_entry_t *pte;   // NULL if the entry is invalid
+	unsigned long last_use;
+	char huge;
+};
+
+struct tlb {
+	struct tlb_entry *entries; // nsets sets of tlb_ways entries
+	unsigned nsets;
+	int random;                // Random instead of LRU replacement
+	unsigned long clock;       // Advances on every lookup, for LRU
+	unsigned long seed;        // xorshift state, for random replacement
+};
+
+static inline struct tlb_entry *tlb_set(struct tlb *tlb, addr_t vpage)
+{
+	return &tlb->entries[(vpage % tlb->nsets) * tlb_ways];
+}
+
+/* Creates the TLB for the current simulation, if tlb_entries is not 0. */
+void tlb_init(void)
+{
+	if (tlb_entries == 0) {
+		sim->tlb = NULL;
+		return;
+	}
+	if (tlb_ways == 0 || tlb_entries % tlb_ways != 0) {
+		fprintf(stderr, "Error: TLB entries must be a multiple of its ways\n");
+		exit(1);
+	}
+
+	struct tlb *tlb = malloc(sizeof(struct tlb));
+	if (tlb == NULL ||
+	    (tlb->entries = calloc(tlb_entries, sizeof(struct tlb_entry))) == NULL) {
+		perror("Failed to allocate TLB");
+		exit(1);
+	}
+	tlb->nsets = tlb_entries / tlb_ways;
+	tlb->clock = 0;
+	tlb->seed = 88172645463325252UL;
+	if (strcmp(tlb_policy, "rand") == 0) {
+		tlb->random = 1;
+	} else if (strcmp(tlb_policy, "lru") == 0) {
+		tlb->random = 0;
+	} else {
+		fprintf(stderr, "Error: invalid TLB replacement policy - %s\n", tlb_policy);
+		exit(1);
+	}
+	sim->tlb = tlb;
+}
+
+void tlb_destroy(void)
+{
+	if (sim->tlb) {
+		free(sim->tlb->entries);
+		free(sim->tlb);
+		sim->tlb = NULL;
+	}
+}
+
+/* Returns the cached page table entry for vpage, or NULL on a TLB miss. */
+pgtbl_entry_t *tlb_lookup(addr_t vpage)
+{
+	struct tlb *tlb = sim->tlb;
+	struct tlb_entry *set = tlb_set(tlb, vpage);
+
+	tlb->clock++;
+	for (unsigned w = 0; w < tlb_ways; w++) {
+		if (set[w].pte && set[w].vpage == vpage && !set[w].huge) {
+			set[w].last_use = tlb->clock;
+			sim->tlb_hit_count++;
+			return set[w].pte;
+		}
+	}
+	if (sim->huge) {
+		unsigned bits = sim->pt_bits[pt_levels - 1];
+		addr_t region = vpage >> bits;
+		set = tlb_set(tlb, region);
+		for (unsigned w = 0; w < tlb_ways; w++) {
+			if (set[w].pte && set[w].vpage == region && set[w].huge) {
+				set[w].last_use = tlb->clock;
+				sim->tlb_hit_count++;
+				sim->tlb_huge_hit_count++;
+				return set[w].pte + (vpage & (((addr_t)1 << bits) - 1));
+			}
+		}
+	}
+	sim->tlb_miss_count++;
+	return NULL;
+}
+
+/* Caches the translation of vpage (which must be in memory) to p,
+ * replacing an invalid entry in its set or else the policy's victim.
+ */
+static void insert(addr_t vpage, pgtbl_entry_t *p, char huge)
+{
+	struct tlb *tlb = sim->tlb;
+	struct tlb_entry *set = tlb_set(tlb, vpage);
+	struct tlb_entry *victim = NULL;
+
+	for (unsigned w = 0; w < tlb_ways && victim == NULL; w++) {
+		if (set[w].pte == NULL) {
+			victim = &set[w];
+		}
+	}
+	if (victim == NULL && tlb->random) {
+		tlb->seed ^= tlb->seed << 13;
+		tlb->seed ^= tlb->seed >> 7;
+		tlb->seed ^= tlb->seed << 17;
+		victim = &set[tlb->seed % tlb_ways];
+	} else if (victim == NULL) {
+		victim = &set[0];
+		for (unsigned w = 1; w < tlb_ways; w++) {
+			if (set[w].last_use < victim->last_use) {
+				victim = &set[w];
+			}
+		}
+	}
+
+	victim->vpage = vpage;
+	victim->pte = p;
+	victim->last_use = tlb->clock;
+	victim->huge = huge;
+}
+
+void tlb_insert(addr_t vpage, pgtbl_entry_t *p)
+{
+	insert(vpage, p, 0);
+}
+
+/* Caches the translation of huge page region, whose leaf table is leaf. */
+void tlb_insert_huge(addr_t region, pgtbl_entry_t *leaf)
+{
+	insert(region, leaf, 1);
+}
+
+static void invalidate(addr_t vpage, char huge)
+{
+	struct tlb_entry *set = tlb_set(sim->tlb, vpage);
+
+	for (unsigned w = 0; w < tlb_ways; w++) {
+		if (set[w].pte && set[w].vpage == vpage && set[w].huge == huge) {
+			set[w].pte = NULL;
+			return;
+		}
+	}
+}
+
+/* Drops any cached translation for vpage, when it leaves memory. */
+void tlb_invalidate(addr_t vpage)
+{
+	invalidate(vpage, 0);
+}
+
+/* Drops any cached translation for huge page region, when it is demoted. */
+void tlb_invalidate_huge(addr_t region)
+{
+	invalidate(region, 1);
+}
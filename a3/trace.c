@@ -0,0 +1,400 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "lz.h"
+#include "trace.h"
+
+const char trace_types[] = "ILSM";
+
+/* Returns the record type code for an access type character,
+ * or -1 if type is not one of the types in trace_types.
+ */
+int trace_type_code(char type)
+{
+	const char *p = strchr(trace_types, type);
+	if (type == '\0' || p == NULL) {
+		return -1;
+	}
+	return p - trace_types;
+}
+
+// Checks the blocks of a compressed trace: they must fill the file exactly
+// and hold all of the records in the header between them.
+static int check_blocks(struct trace *t, const char *path)
+{
+	const struct trace_header *hdr = t->map;
+	size_t off = sizeof(*hdr);
+	uint64_t nrecs = 0;
+
+	while (off < t->maplen) {
+		struct trace_block blk;
+		if (t->maplen - off < sizeof(blk)) {
+			fprintf(stderr, "%s: truncated trace block\n", path);
+			return -1;
+		}
+		memcpy(&blk, (const char *)t->map + off, sizeof(blk));
+		off += sizeof(blk);
+		if (blk.nrecs == 0 || blk.nrecs > TRACE_BLOCK_RECS ||
+		    blk.raw_len > TRACE_BLOCK_BOUND(blk.nrecs) ||
+		    blk.len > blk.raw_len || blk.len > t->maplen - off) {
+			fprintf(stderr, "%s: corrupt trace block at offset %zu\n",
+			        path, off - sizeof(blk));
+			return -1;
+		}
+		off += blk.len;
+		nrecs += blk.nrecs;
+	}
+	if (nrecs != hdr->nrecs) {
+		fprintf(stderr, "%s: trace length does not match header\n", path);
+		return -1;
+	}
+
+	if ((t->block = malloc(TRACE_BLOCK_RECS * sizeof(trace_rec_t))) == NULL ||
+	    (t->zbuf = malloc(TRACE_BLOCK_BOUND(TRACE_BLOCK_RECS))) == NULL) {
+		perror("trace_open: malloc");
+		return -1;
+	}
+	t->compressed = 1;
+	t->zpos = sizeof(*hdr);
+	t->nrecs = hdr->nrecs;
+	return 0;
+}
+
+// Maps a binary or compressed trace and checks that its header is one we
+// understand.
+static int map_binary(struct trace *t, int fd, const char *path)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		perror("trace_open: fstat");
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(struct trace_header)) {
+		fprintf(stderr, "%s: truncated trace header\n", path);
+		return -1;
+	}
+
+	t->maplen = st.st_size;
+	t->map = mmap(NULL, t->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (t->map == MAP_FAILED) {
+		perror("trace_open: mmap");
+		return -1;
+	}
+	// Records are consumed front to back exactly once
+	madvise(t->map, t->maplen, MADV_SEQUENTIAL);
+
+	struct trace_header *hdr = t->map;
+	if (hdr->version != TRACE_VERSION) {
+		fprintf(stderr, "%s: unsupported trace version %u\n",
+		        path, hdr->version);
+		return -1;
+	}
+	if (hdr->page_shift != PAGE_SHIFT) {
+		fprintf(stderr, "%s: trace uses page shift %u, expected %d\n",
+		        path, hdr->page_shift, PAGE_SHIFT);
+		return -1;
+	}
+	if (memcmp(hdr->magic, TRACE_ZMAGIC, sizeof(hdr->magic)) == 0) {
+		return check_blocks(t, path);
+	}
+	if (hdr->nrecs != (t->maplen - sizeof(*hdr)) / sizeof(trace_rec_t)) {
+		fprintf(stderr, "%s: trace length does not match header\n", path);
+		return -1;
+	}
+
+	t->recs = (const trace_rec_t *)(hdr + 1);
+	t->nrecs = hdr->nrecs;
+	return 0;
+}
+
+/* Opens a trace file, detecting whether it is in the binary, compressed or
+ * text format.
+ * Returns NULL (after printing an error) if the file cannot be used.
+ */
+struct trace *trace_open(const char *path)
+{
+	struct trace *t = calloc(1, sizeof(struct trace));
+	if (t == NULL) {
+		perror("trace_open: calloc");
+		return NULL;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		perror("Error opening tracefile");
+		free(t);
+		return NULL;
+	}
+
+	char magic[sizeof(((struct trace_header *)0)->magic)];
+	ssize_t n = pread(fd, magic, sizeof(magic), 0);
+	if (n == (ssize_t)sizeof(magic) &&
+	    (memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0 ||
+	     memcmp(magic, TRACE_ZMAGIC, sizeof(magic)) == 0)) {
+		int err = map_binary(t, fd, path);
+		close(fd);
+		if (err) {
+			trace_close(t);
+			return NULL;
+		}
+		return t;
+	}
+
+	if ((t->fp = fdopen(fd, "r")) == NULL) {
+		perror("trace_open: fdopen");
+		close(fd);
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+static void corrupt_block(void)
+{
+	fprintf(stderr, "Error: corrupt block in compressed trace\n");
+	exit(1);
+}
+
+// Decodes the next block of a compressed trace into t->block. Returns 0 at
+// the end of the trace.
+static int decode_block(struct trace *t)
+{
+	struct trace_block blk;
+
+	if (t->zpos == t->maplen) {
+		return 0;
+	}
+	memcpy(&blk, (const char *)t->map + t->zpos, sizeof(blk));
+	const unsigned char *data = (const unsigned char *)t->map + t->zpos + sizeof(blk);
+	t->zpos += sizeof(blk) + blk.len;
+
+	if (blk.len < blk.raw_len) {
+		if (lz_decompress(data, blk.len, t->zbuf, blk.raw_len) != blk.raw_len) {
+			corrupt_block();
+		}
+		data = t->zbuf;
+	}
+
+	size_t ip = (blk.nrecs + 3) / 4;  // The varints follow the type codes
+	uint64_t page = 0;
+	if (ip > blk.raw_len) {
+		corrupt_block();
+	}
+	for (uint32_t i = 0; i < blk.nrecs; i++) {
+		uint64_t z = 0;
+		unsigned char b;
+		for (unsigned shift = 0; ; shift += 7) {
+			if (ip == blk.raw_len || shift > 63) {
+				corrupt_block();
+			}
+			b = data[ip++];
+			z |= (uint64_t)(b & 0x7f) << shift;
+			if (!(b & 0x80)) {
+				break;
+			}
+		}
+		page += (z >> 1) ^ -(z & 1);
+		unsigned code = (data[i / 4] >> (2 * (i % 4))) & TRACE_TYPE_MASK;
+		t->block[i] = (page << TRACE_TYPE_BITS) | code;
+	}
+	if (ip != blk.raw_len) {
+		corrupt_block();
+	}
+	t->block_len = blk.nrecs;
+	t->block_pos = 0;
+	return 1;
+}
+
+/* Returns the rest of the current block of a compressed trace in recs,
+ * decoding the next block first if the current one is used up, and moves
+ * past them. This lets the replay go through the trace a block at a time.
+ * Returns the number of records, or 0 at the end of the trace.
+ */
+size_t trace_next_block(struct trace *t, const trace_rec_t **recs)
+{
+	if (t->block_pos == t->block_len && !decode_block(t)) {
+		return 0;
+	}
+	size_t n = t->block_len - t->block_pos;
+	*recs = t->block + t->block_pos;
+	t->block_pos = t->block_len;
+	t->pos += n;
+	return n;
+}
+
+/* Reads the next reference from the trace into type and vaddr, with the
+ * PID of the process that made it in the bits above VADDR_BITS.
+ * Returns 1 if a reference was read, or 0 at the end of the trace.
+ * Text lines starting with '=' and lines that do not parse are skipped.
+ */
+int trace_next(struct trace *t, char *type, addr_t *vaddr)
+{
+	if (t->recs) {
+		if (t->pos == t->nrecs) {
+			return 0;
+		}
+		trace_rec_t r = t->recs[t->pos++];
+		*type = TRACE_REC_TYPE(r);
+		*vaddr = TRACE_REC_VADDR(r);
+		return 1;
+	}
+
+	if (t->compressed) {
+		if (t->block_pos == t->block_len && !decode_block(t)) {
+			return 0;
+		}
+		trace_rec_t r = t->block[t->block_pos++];
+		*type = TRACE_REC_TYPE(r);
+		*vaddr = TRACE_REC_VADDR(r);
+		t->pos++;
+		return 1;
+	}
+
+	char buf[MAXLINE];
+	while (fgets(buf, MAXLINE, t->fp) != NULL) {
+		int len;
+		if (buf[0] != '=' && sscanf(buf, "%c %lx%n", type, vaddr, &len) == 2) {
+			// Other fields (e.g. an access size) are ignored; only an
+			// explicit pid= tag gives the reference a process
+			unsigned long pid = 0;
+			char *tag = strstr(buf + len, "pid=");
+			if (tag != NULL) {
+				pid = strtoul(tag + 4, NULL, 10);
+			}
+			if (VADDR_PID(*vaddr) != 0) {
+				fprintf(stderr, "Error: address %lx is wider than %d bits\n",
+				        *vaddr, VADDR_BITS);
+				exit(1);
+			}
+			if (pid > PID_MAX) {
+				fprintf(stderr, "Error: PID %lu is larger than %u\n", pid, PID_MAX);
+				exit(1);
+			}
+			*vaddr = VADDR_TAG(pid, *vaddr);
+			t->pos++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Reads the rest of a text or compressed trace into memory as binary
+ * records, so that it can be replayed (and shared) like a mapped binary
+ * trace. Returns 0 on success, or -1 if the trace has an unknown access
+ * type.
+ */
+int trace_load(struct trace *t)
+{
+	if (t->recs) {
+		return 0;
+	}
+
+	if (t->compressed) {
+		uint64_t n = 0;
+		size_t count;
+		const trace_rec_t *recs;
+		trace_rec_t *buf = malloc((t->nrecs - t->pos + 1) * sizeof(trace_rec_t));
+		if (buf == NULL) {
+			perror("trace_load: malloc");
+			exit(1);
+		}
+		while ((count = trace_next_block(t, &recs)) > 0) {
+			memcpy(buf + n, recs, count * sizeof(trace_rec_t));
+			n += count;
+		}
+		t->buf = buf;
+		t->recs = buf;
+		t->nrecs = n;
+		t->pos = 0;
+		return 0;
+	}
+
+	uint64_t cap = 1 << 20, n = 0;
+	trace_rec_t *buf = malloc(cap * sizeof(trace_rec_t));
+	if (buf == NULL) {
+		perror("trace_load: malloc");
+		exit(1);
+	}
+
+	char type;
+	addr_t vaddr;
+	while (trace_next(t, &type, &vaddr)) {
+		int code = trace_type_code(type);
+		if (code < 0) {
+			fprintf(stderr, "trace_load: unknown access type '%c'\n", type);
+			free(buf);
+			return -1;
+		}
+		if (n == cap) {
+			cap *= 2;
+			if ((buf = realloc(buf, cap * sizeof(trace_rec_t))) == NULL) {
+				perror("trace_load: realloc");
+				exit(1);
+			}
+		}
+		buf[n++] = TRACE_REC(code, vaddr);
+	}
+
+	fclose(t->fp);
+	t->fp = NULL;
+	t->buf = buf;
+	t->recs = buf;
+	t->nrecs = n;
+	t->pos = 0;
+	return 0;
+}
+
+/* Initializes view as an independent reader of the in-memory trace t, with
+ * its own position. Views share t's records and must not be closed.
+ */
+void trace_view(struct trace *view, const struct trace *t)
+{
+	memset(view, 0, sizeof(*view));
+	view->recs = t->recs;
+	view->nrecs = t->nrecs;
+}
+
+// Restarts the trace from the first reference.
+void trace_rewind(struct trace *t)
+{
+	if (t->fp) {
+		rewind(t->fp);
+	}
+	if (t->compressed && !t->recs) {
+		t->zpos = sizeof(struct trace_header);
+		t->block_len = t->block_pos = 0;
+	}
+	t->pos = 0;
+}
+
+void trace_close(struct trace *t)
+{
+	if (t->fp) {
+		fclose(t->fp);
+	}
+	if (t->map && t->map != MAP_FAILED) {
+		munmap(t->map, t->maplen);
+	}
+	free(t->buf);
+	free(t->block);
+	free(t->zbuf);
+	free(t);
+}
@@ -0,0 +1,123 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pagetable.h"
+
+/* Binary trace format.
+ *
+ * A binary trace is a struct trace_header followed by header.nrecs 64-bit
+ * records, one per memory reference, in host byte order. Each record holds
+ * the virtual page number in the upper bits and a 2-bit access type code
+ * (an index into trace_types) in the low bits. The fixed record size means
+ * the simulator can mmap the file and replay it without any parsing.
+ *
+ * Only the page number is kept, so converting an addr-*.ref trace drops the
+ * offset within the page. The simulator works at page granularity anyway.
+ *
+ * In a multi-process trace, each reference may be tagged with the PID of
+ * the process that made it: in a text trace with a "pid=" field after the
+ * address ("L 4a2b00 pid=3"), and in a binary record in the bits above the
+ * page number. Any other fields after the address, such as the access size
+ * some traces have, are ignored. trace_next() returns the PID in the
+ * address bits above VADDR_BITS (see VADDR_TAG in pagetable.h). Untagged
+ * references, and all those in older traces, belong to process 0.
+ *
+ * Compressed trace format.
+ *
+ * A compressed trace has the same header, with TRACE_ZMAGIC, followed by
+ * blocks of at most TRACE_BLOCK_RECS records. Each block is a struct
+ * trace_block followed by its len bytes of data. The records of a block
+ * are encoded as their type codes, packed four to a byte starting from the
+ * low bits, then the page number (and PID) of each record as the
+ * difference from the one before it in the block, zigzag-encoded so small
+ * negative strides stay small, as a varint: 7 bits per byte, low bits
+ * first, with the top bit set on all but the last byte. If LZ compression
+ * (see lz.h) makes the encoded block smaller, the block holds that
+ * instead, and len is less than raw_len.
+ *
+ * Blocks are decoded one at a time as the trace is replayed (see
+ * trace_next_block()), so the whole trace is never in memory at once.
+ */
+#define TRACE_MAGIC     "VMTRACE"  // 7 characters plus the terminating NUL
+#define TRACE_ZMAGIC    "VMTRACZ"
+#define TRACE_VERSION   1
+#define TRACE_TYPE_BITS 2
+#define TRACE_TYPE_MASK ((1 << TRACE_TYPE_BITS) - 1)
+#define TRACE_BLOCK_RECS 65536
+
+// Largest encoded size of a block of n records, before LZ compression
+#define TRACE_BLOCK_BOUND(n) (((n) + 3) / 4 + (size_t)(n) * 10)
+
+struct trace_block {
+	uint32_t nrecs;      // Records in the block
+	uint32_t raw_len;    // Bytes of encoded records
+	uint32_t len;        // Bytes of data that follow
+};
+
+struct trace_header {
+	char magic[8];       // TRACE_MAGIC
+	uint32_t version;    // TRACE_VERSION
+	uint32_t page_shift; // PAGE_SHIFT used to compute the page numbers
+	uint64_t nrecs;      // Number of records following the header
+};
+
+typedef uint64_t trace_rec_t;
+
+// Access types, in record type code order
+extern const char trace_types[];
+
+#define TRACE_REC(code, vaddr) \
+	((((trace_rec_t)(vaddr) >> PAGE_SHIFT) << TRACE_TYPE_BITS) | (code))
+#define TRACE_REC_TYPE(r)  (trace_types[(r) & TRACE_TYPE_MASK])
+#define TRACE_REC_VADDR(r) ((addr_t)((r) >> TRACE_TYPE_BITS) << PAGE_SHIFT)
+
+/* An open trace file, in any format.
+ * For a binary trace, recs points at the mmap'd records and fp is NULL.
+ * For a text trace, fp is the open file and recs is NULL, until the trace
+ * is read into memory by trace_load(), after which recs points at buf.
+ * For a compressed trace, the file is mapped too, and recs is NULL until
+ * trace_load(): records are decoded a block at a time into block.
+ */
+struct trace {
+	FILE *fp;
+	const trace_rec_t *recs;
+	uint64_t nrecs;
+	uint64_t pos;        // Next record to return from trace_next()
+	void *map;
+	size_t maplen;
+	trace_rec_t *buf;
+
+	int compressed;
+	size_t zpos;         // Offset in map of the next block to decode
+	trace_rec_t *block;  // The decoded block
+	uint32_t block_len;
+	uint32_t block_pos;  // Next record of block to return
+	unsigned char *zbuf; // A block's encoded records, after LZ
+};
+
+struct trace *trace_open(const char *path);
+int trace_load(struct trace *t);
+void trace_view(struct trace *view, const struct trace *t);
+int trace_next(struct trace *t, char *type, addr_t *vaddr);
+size_t trace_next_block(struct trace *t, const trace_rec_t **recs);
+void trace_rewind(struct trace *t);
+void trace_close(struct trace *t);
+int trace_type_code(char type);
+
+#endif /* __TRACE_H__ */
@@ -0,0 +1,214 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* Converts a trace between the text, binary and compressed formats (see
+ * trace.h). A text trace is converted to binary, and a binary or compressed
+ * trace back to text. With -z level, any trace is converted to the
+ * compressed format: level 1 only delta-encodes the blocks, and level 2
+ * also LZ-compresses them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lz.h"
+#include "trace.h"
+
+static int write_binary(struct trace *t, FILE *out)
+{
+	struct trace_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.page_shift = PAGE_SHIFT;
+
+	// Write a placeholder header, then fill in the count at the end
+	if (fwrite(&hdr, sizeof(hdr), 1, out) != 1) {
+		return -1;
+	}
+
+	char type;
+	addr_t vaddr;
+	while (trace_next(t, &type, &vaddr)) {
+		int code = trace_type_code(type);
+		if (code < 0) {
+			fprintf(stderr, "tracebin: unknown access type '%c' at reference %lu\n",
+			        type, (unsigned long)t->pos);
+			return -1;
+		}
+		trace_rec_t r = TRACE_REC(code, vaddr);
+		if (fwrite(&r, sizeof(r), 1, out) != 1) {
+			return -1;
+		}
+		hdr.nrecs++;
+	}
+
+	if (fseek(out, 0, SEEK_SET) != 0 ||
+	    fwrite(&hdr, sizeof(hdr), 1, out) != 1) {
+		return -1;
+	}
+	return 0;
+}
+
+// Encodes the n records in recs as one block (see trace.h) and writes it.
+static int write_block(const trace_rec_t *recs, uint32_t n, int level,
+                       unsigned char *raw, unsigned char *packed, FILE *out)
+{
+	size_t len = (n + 3) / 4;
+	uint64_t prev = 0;
+
+	memset(raw, 0, len);
+	for (uint32_t i = 0; i < n; i++) {
+		raw[i / 4] |= (recs[i] & TRACE_TYPE_MASK) << (2 * (i % 4));
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		uint64_t page = recs[i] >> TRACE_TYPE_BITS;
+		int64_t delta = (int64_t)(page - prev);
+		uint64_t z = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+		for (; z >= 0x80; z >>= 7) {
+			raw[len++] = (z & 0x7f) | 0x80;
+		}
+		raw[len++] = z;
+		prev = page;
+	}
+
+	struct trace_block blk = {n, len, len};
+	const unsigned char *data = raw;
+	if (level >= 2) {
+		size_t packed_len = lz_compress(raw, len, packed);
+		if (packed_len < len) {
+			blk.len = packed_len;
+			data = packed;
+		}
+	}
+	if (fwrite(&blk, sizeof(blk), 1, out) != 1 ||
+	    fwrite(data, 1, blk.len, out) != blk.len) {
+		return -1;
+	}
+	return 0;
+}
+
+static int write_compressed(struct trace *t, FILE *out, int level)
+{
+	struct trace_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_ZMAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.page_shift = PAGE_SHIFT;
+
+	// Write a placeholder header, then fill in the count at the end
+	if (fwrite(&hdr, sizeof(hdr), 1, out) != 1) {
+		return -1;
+	}
+
+	trace_rec_t *recs = malloc(TRACE_BLOCK_RECS * sizeof(trace_rec_t));
+	unsigned char *raw = malloc(TRACE_BLOCK_BOUND(TRACE_BLOCK_RECS));
+	unsigned char *packed = malloc(LZ_BOUND(TRACE_BLOCK_BOUND(TRACE_BLOCK_RECS)));
+	if (recs == NULL || raw == NULL || packed == NULL) {
+		perror("tracebin: malloc");
+		exit(1);
+	}
+
+	char type;
+	addr_t vaddr;
+	uint32_t n = 0;
+	int err = 0;
+	while (!err && trace_next(t, &type, &vaddr)) {
+		int code = trace_type_code(type);
+		if (code < 0) {
+			fprintf(stderr, "tracebin: unknown access type '%c' at reference %lu\n",
+			        type, (unsigned long)t->pos);
+			err = -1;
+			break;
+		}
+		recs[n++] = TRACE_REC(code, vaddr);
+		hdr.nrecs++;
+		if (n == TRACE_BLOCK_RECS) {
+			err = write_block(recs, n, level, raw, packed, out);
+			n = 0;
+		}
+	}
+	if (!err && n > 0) {
+		err = write_block(recs, n, level, raw, packed, out);
+	}
+	free(recs);
+	free(raw);
+	free(packed);
+
+	if (err || fseek(out, 0, SEEK_SET) != 0 ||
+	    fwrite(&hdr, sizeof(hdr), 1, out) != 1) {
+		return -1;
+	}
+	return 0;
+}
+
+static int write_text(struct trace *t, FILE *out)
+{
+	char type;
+	addr_t vaddr;
+	while (trace_next(t, &type, &vaddr)) {
+		unsigned long pid = VADDR_PID(vaddr);
+		vaddr &= ~VADDR_TAG(pid, 0);
+		int err = pid ? fprintf(out, "%c %lx pid=%lu\n", type, vaddr, pid)
+		              : fprintf(out, "%c %lx\n", type, vaddr);
+		if (err < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char *usage = "USAGE: tracebin [-z 1|2] infile outfile\n";
+	int level = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "z:")) != -1) {
+		if (opt != 'z' || (level = atoi(optarg)) < 1 || level > 2) {
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+	}
+	if (argc - optind != 2) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+
+	struct trace *t = trace_open(argv[optind]);
+	if (t == NULL) {
+		exit(1);
+	}
+
+	FILE *out = fopen(argv[optind + 1], "w");
+	if (out == NULL) {
+		perror("Error opening output file");
+		exit(1);
+	}
+
+	int err;
+	if (level > 0) {
+		err = write_compressed(t, out, level);
+	} else if (t->recs || t->compressed) {
+		err = write_text(t, out);
+	} else {
+		err = write_binary(t, out);
+	}
+	if (err || fclose(out) != 0) {
+		perror("tracebin: failed to write output");
+		exit(1);
+	}
+	trace_close(t);
+	return 0;
+}
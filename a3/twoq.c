@@ -0,0 +1,213 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* 2Q (Johnson and Shasha), with CLOCK in place of LRU for the main queue.
+ *
+ * A page that is brought in for the first time goes on A1in, a FIFO of at
+ * most a quarter of memory. When it is evicted from A1in its virtual page
+ * is remembered on A1out, a FIFO of ghosts half the size of memory. Only a
+ * page that misses again while it is on A1out goes into the main queue,
+ * Am, so a one-time scan passes through A1in without disturbing Am.
+ *
+ * Am is managed by CLOCK, so a hit only sets PG_REF, just like clock_ref().
+ * The queues are changed only when a page is brought in or evicted.
+ */
+#include "pagetable.h"
+#include "sim.h"
+#include "vpmap.h"
+
+enum { NONE, A1IN, AM };
+
+struct twoq_data {
+	char *queue;       // Queue each frame is on
+	int *next;         // Links of A1in (a FIFO) and Am (a circular list)
+	int *prev;
+
+	int in_head;       // Oldest page on A1in, or -1
+	int in_tail;
+	unsigned in_size;
+	unsigned in_max;
+
+	int hand;          // CLOCK hand on Am, or -1 if Am is empty
+
+	// A1out is a ring of the last out_max virtual pages evicted from A1in.
+	// out_pages maps each of them to its sequence number, so a page that
+	// has left A1out early (because it missed again) is not removed twice.
+	addr_t *out_ring;
+	unsigned long out_seq;
+	unsigned out_max;
+	struct vpmap *out_pages;
+};
+
+static int a1in_pop(struct twoq_data *q)
+{
+	int frame = q->in_head;
+	q->in_head = q->next[frame];
+	if (q->in_head == -1) {
+		q->in_tail = -1;
+	}
+	q->in_size--;
+	return frame;
+}
+
+static void a1in_push(struct twoq_data *q, int frame)
+{
+	q->next[frame] = -1;
+	if (q->in_tail != -1) {
+		q->next[q->in_tail] = frame;
+	} else {
+		q->in_head = frame;
+	}
+	q->in_tail = frame;
+	q->in_size++;
+}
+
+// Inserts frame into Am just behind the hand, so it is the last page the
+// hand reaches.
+static void am_insert(struct twoq_data *q, int frame)
+{
+	if (q->hand == -1) {
+		q->next[frame] = q->prev[frame] = frame;
+		q->hand = frame;
+		return;
+	}
+	int before = q->prev[q->hand];
+	q->prev[frame] = before;
+	q->next[frame] = q->hand;
+	q->next[before] = frame;
+	q->prev[q->hand] = frame;
+}
+
+static void am_remove(struct twoq_data *q, int frame)
+{
+	if (q->next[frame] == frame) {
+		q->hand = -1;
+		return;
+	}
+	q->next[q->prev[frame]] = q->next[frame];
+	q->prev[q->next[frame]] = q->prev[frame];
+	if (q->hand == frame) {
+		q->hand = q->next[frame];
+	}
+}
+
+static void a1out_add(struct twoq_data *q, addr_t vpage)
+{
+	addr_t *slot = &q->out_ring[q->out_seq % q->out_max];
+	long seq;
+
+	if (q->out_seq >= q->out_max && vpmap_get(q->out_pages, *slot, &seq) &&
+	    (unsigned long)seq == q->out_seq - q->out_max) {
+		vpmap_remove(q->out_pages, *slot);
+	}
+	*slot = vpage;
+	vpmap_put(q->out_pages, vpage, q->out_seq++);
+}
+
+/* Page to evict is chosen using the 2Q algorithm: the oldest page on A1in
+ * if A1in is over its share of memory, otherwise the page CLOCK picks on Am.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int twoq_evict(void)
+{
+	struct twoq_data *q = sim->alg_data;
+	struct frame *coremap = sim->coremap;
+	int frame;
+
+	if (q->in_size > q->in_max || (q->hand == -1 && q->in_size > 0)) {
+		frame = a1in_pop(q);
+		a1out_add(q, coremap[frame].vaddr >> PAGE_SHIFT);
+	} else {
+		while (coremap[q->hand].pte->frame & PG_REF) {
+			coremap[q->hand].pte->frame &= ~PG_REF;
+			q->hand = q->next[q->hand];
+		}
+		frame = q->hand;
+		am_remove(q, frame);
+	}
+	q->queue[frame] = NONE;
+	return frame;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the 2Q algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void twoq_ref(pgtbl_entry_t *p)
+{
+	struct twoq_data *q = sim->alg_data;
+
+	p->frame |= PG_REF;
+	if (q->queue[p->frame >> PAGE_SHIFT] == NONE) {
+		twoq_insert(p);
+	}
+}
+
+/* Called for a page that was just brought in, by a reference or not.
+ * Queues it in A1in, or in Am if it is in A1out.
+ */
+void twoq_insert(pgtbl_entry_t *p)
+{
+	struct twoq_data *q = sim->alg_data;
+	int frame = p->frame >> PAGE_SHIFT;
+	addr_t vpage = sim->coremap[frame].vaddr >> PAGE_SHIFT;
+
+	if (vpmap_remove(q->out_pages, vpage)) {
+		sim->ghost_recent_hit_count++;
+		q->queue[frame] = AM;
+		am_insert(q, frame);
+	} else {
+		q->queue[frame] = A1IN;
+		a1in_push(q, frame);
+	}
+}
+
+/* Initialize any data structures needed for this replacement algorithm. */
+void twoq_init(void)
+{
+	unsigned memsize = sim->memsize;
+	struct twoq_data *q = calloc(1, sizeof(struct twoq_data));
+	if (q == NULL) {
+		perror("twoq_init: calloc");
+		exit(1);
+	}
+	q->in_max = memsize / 4 ? memsize / 4 : 1;
+	q->out_max = memsize / 2 ? memsize / 2 : 1;
+	q->queue = calloc(memsize, sizeof(char));
+	q->next = malloc(memsize * sizeof(int));
+	q->prev = malloc(memsize * sizeof(int));
+	q->out_ring = malloc(q->out_max * sizeof(addr_t));
+	if (q->queue == NULL || q->next == NULL || q->prev == NULL ||
+	    q->out_ring == NULL) {
+		perror("twoq_init: malloc");
+		exit(1);
+	}
+	q->in_head = q->in_tail = -1;
+	q->hand = -1;
+	q->out_pages = vpmap_create(q->out_max);
+	sim->alg_data = q;
+}
+
+/* Cleanup any data structures created in twoq_init(). */
+void twoq_cleanup(void)
+{
+	struct twoq_data *q = sim->alg_data;
+	vpmap_destroy(q->out_pages);
+	free(q->out_ring);
+	free(q->queue);
+	free(q->next);
+	free(q->prev);
+	free(q);
+}
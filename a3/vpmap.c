@@ -0,0 +1,162 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vpmap.h"
+
+// Open addressing with linear probing. Keys are stored as vpage + 1 so that
+// a zero key marks an empty slot. The table doubles when it is half full.
+
+#define VPMAP_MIN_BITS 10
+
+struct vpmap_slot {
+	addr_t key;
+	long val;
+};
+
+struct vpmap {
+	unsigned bits;
+	unsigned long count;
+	struct vpmap_slot *slots;
+};
+
+static inline unsigned long slot_of(struct vpmap *m, addr_t key)
+{
+	return (unsigned long)((key * 0x9E3779B97F4A7C15UL) >> (64 - m->bits));
+}
+
+static void vpmap_alloc(struct vpmap *m, unsigned bits)
+{
+	m->bits = bits;
+	m->slots = calloc(1UL << bits, sizeof(struct vpmap_slot));
+	if (m->slots == NULL) {
+		perror("vpmap: failed to allocate table");
+		exit(1);
+	}
+}
+
+static void vpmap_grow(struct vpmap *m)
+{
+	struct vpmap_slot *old = m->slots;
+	unsigned long oldsize = 1UL << m->bits;
+
+	vpmap_alloc(m, m->bits + 1);
+	unsigned long mask = (1UL << m->bits) - 1;
+	for (unsigned long i = 0; i < oldsize; i++) {
+		if (old[i].key != 0) {
+			unsigned long s = slot_of(m, old[i].key);
+			while (m->slots[s].key != 0) {
+				s = (s + 1) & mask;
+			}
+			m->slots[s] = old[i];
+		}
+	}
+	free(old);
+}
+
+/* Creates an empty map sized to hold about hint pages without growing. */
+struct vpmap *vpmap_create(unsigned long hint)
+{
+	struct vpmap *m = malloc(sizeof(struct vpmap));
+	if (m == NULL) {
+		perror("vpmap: failed to allocate map");
+		exit(1);
+	}
+	unsigned bits = VPMAP_MIN_BITS;
+	while ((1UL << bits) < 2 * hint) {
+		bits++;
+	}
+	m->count = 0;
+	vpmap_alloc(m, bits);
+	return m;
+}
+
+void vpmap_destroy(struct vpmap *m)
+{
+	free(m->slots);
+	free(m);
+}
+
+/* Looks up vpage. Returns 1 and stores its value in *val if present,
+ * otherwise returns 0.
+ */
+int vpmap_get(struct vpmap *m, addr_t vpage, long *val)
+{
+	addr_t key = vpage + 1;
+	unsigned long mask = (1UL << m->bits) - 1;
+	for (unsigned long s = slot_of(m, key); m->slots[s].key != 0;
+	     s = (s + 1) & mask) {
+		if (m->slots[s].key == key) {
+			*val = m->slots[s].val;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Sets the value for vpage, adding it to the map if needed. */
+void vpmap_put(struct vpmap *m, addr_t vpage, long val)
+{
+	addr_t key = vpage + 1;
+	if (2 * (m->count + 1) > (1UL << m->bits)) {
+		vpmap_grow(m);
+	}
+	unsigned long mask = (1UL << m->bits) - 1;
+	unsigned long s = slot_of(m, key);
+	while (m->slots[s].key != 0 && m->slots[s].key != key) {
+		s = (s + 1) & mask;
+	}
+	if (m->slots[s].key == 0) {
+		m->slots[s].key = key;
+		m->count++;
+	}
+	m->slots[s].val = val;
+}
+
+/* Removes vpage from the map. Returns 1 if it was present, 0 if not.
+ * Later entries in the probe run are shifted back so no tombstones are left.
+ */
+int vpmap_remove(struct vpmap *m, addr_t vpage)
+{
+	addr_t key = vpage + 1;
+	unsigned long mask = (1UL << m->bits) - 1;
+	unsigned long s = slot_of(m, key);
+	while (m->slots[s].key != key) {
+		if (m->slots[s].key == 0) {
+			return 0;
+		}
+		s = (s + 1) & mask;
+	}
+
+	unsigned long hole = s;
+	for (s = (s + 1) & mask; m->slots[s].key != 0; s = (s + 1) & mask) {
+		// An entry can fill the hole if its home slot is not between
+		// the hole and its current position (cyclically).
+		unsigned long home = slot_of(m, m->slots[s].key);
+		if (((s - home) & mask) >= ((s - hole) & mask)) {
+			m->slots[hole] = m->slots[s];
+			hole = s;
+		}
+	}
+	m->slots[hole].key = 0;
+	assert(m->count > 0);
+	m->count--;
+	return 1;
+}
+
+unsigned long vpmap_count(struct vpmap *m)
+{
+	return m->count;
+}
@@ -0,0 +1,32 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+#ifndef __VPMAP_H__
+#define __VPMAP_H__
+
+#include "pagetable.h"
+
+/* A hash map from virtual page numbers to long values, for algorithms that
+ * need to track pages that are not (or are no longer) in the page table.
+ */
+struct vpmap;
+
+struct vpmap *vpmap_create(unsigned long hint);
+void vpmap_destroy(struct vpmap *m);
+int vpmap_get(struct vpmap *m, addr_t vpage, long *val);
+void vpmap_put(struct vpmap *m, addr_t vpage, long val);
+int vpmap_remove(struct vpmap *m, addr_t vpage);
+unsigned long vpmap_count(struct vpmap *m);
+
+#endif /* __VPMAP_H__ */
@@ -0,0 +1,115 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* WSClock (Carr and Hennessy).
+ *
+ * Virtual time is the number of references made so far (sim->ref_count).
+ * Each frame records the virtual time of its last use. A page whose last
+ * use is more than wsclock_tau references ago has left the working set
+ * and may be evicted. The hand sweeps the frames in order; the first clean
+ * page outside the working set is the victim. A dirty page outside the
+ * working set is not evicted but cleaned (written to swap) so that a later
+ * sweep can take it without a write on the fault path.
+ */
+#include "pagetable.h"
+#include "sim.h"
+
+// Most dirty pages cleaned in one sweep
+#define WSCLOCK_MAX_WRITES 16
+
+// Working set window, in references (sim -T); 0 means memsize references
+unsigned long wsclock_tau = 0;
+
+struct wsclock_data {
+	unsigned long *last_use;
+	unsigned long tau;
+	unsigned hand;
+};
+
+/* Page to evict is chosen using the WSClock algorithm.
+ * If a whole sweep finds no page outside the working set, the page that
+ * was used longest ago is evicted instead.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int wsclock_evict(void)
+{
+	struct wsclock_data *w = sim->alg_data;
+	struct frame *coremap = sim->coremap;
+	unsigned long now = sim->ref_count;
+	unsigned memsize = sim->memsize;
+	unsigned writes = 0;
+	int oldest = -1;
+
+	// Pages cleaned in the first pass can be taken in a second one
+	for (unsigned long i = 0; i < (writes ? 2UL : 1UL) * memsize; i++) {
+		unsigned f = w->hand;
+		w->hand = (w->hand + 1) % memsize;
+
+		if (now - w->last_use[f] > w->tau) {
+			if (!(coremap[f].pte->frame & PG_DIRTY)) {
+				return f;
+			}
+			if (writes < WSCLOCK_MAX_WRITES && i < memsize) {
+				clean_frame(f);
+				writes++;
+			}
+		}
+		if (oldest == -1 || w->last_use[f] < w->last_use[oldest]) {
+			oldest = f;
+		}
+	}
+	return oldest;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the WSClock algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void wsclock_ref(pgtbl_entry_t *p)
+{
+	struct wsclock_data *w = sim->alg_data;
+	w->last_use[p->frame >> PAGE_SHIFT] = sim->ref_count;
+}
+
+/* Called for a page brought in without a reference. Until it is used it
+ * is not in the working set, so the hand may take it when it comes by.
+ */
+void wsclock_insert(pgtbl_entry_t *p)
+{
+	struct wsclock_data *w = sim->alg_data;
+	w->last_use[p->frame >> PAGE_SHIFT] = 0;
+}
+
+/* Initialize any data structures needed for this replacement algorithm. */
+void wsclock_init(void)
+{
+	struct wsclock_data *w = malloc(sizeof(struct wsclock_data));
+	if (w == NULL ||
+	    (w->last_use = calloc(sim->memsize, sizeof(unsigned long))) == NULL) {
+		perror("wsclock_init: malloc");
+		exit(1);
+	}
+	w->tau = wsclock_tau ? wsclock_tau : sim->memsize;
+	w->hand = 0;
+	sim->alg_data = w;
+}
+
+/* Cleanup any data structures created in wsclock_init(). */
+void wsclock_cleanup(void)
+{
+	struct wsclock_data *w = sim->alg_data;
+	free(w->last_use);
+	free(w);
+}
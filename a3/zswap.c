@@ -0,0 +1,382 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Andrew Peterson, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2020 Karen Reid
+ */
+
+/* A compressed in-memory tier in front of the swap area, as in Linux's
+ * zswap.
+ *
+ * A page written to swap is compressed and kept in a pool in memory
+ * instead, under its swap slot. The swap area is only written when the
+ * pool is full: the least recently stored pages are written back to their
+ * slots to make room. A page that does not compress goes straight to the
+ * swap area. Reads of a slot in the pool are served from it, and the page
+ * stays in the pool, so a clean page can still be dropped on eviction.
+ *
+ * Pages are compressed with the LZ codec in lz.c.
+ * The pool is a slab allocator with one size class per ZS_CLASSES-th of a
+ * page; each slab holds up to ZS_SLAB_OBJS objects of its class, fewer if
+ * that would take more than a ZS_SLAB_SHARE-th of the pool. The pool's size
+ * is the memory of all of its slabs, and it may not grow past zswap_percent
+ * percent of the simulated memory (sim -Z).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "sim.h"
+#include "lz.h"
+#include "vpmap.h"
+#include "zswap.h"
+
+// Size of the pool in percent of memory (sim -Z); 0 disables it
+unsigned zswap_percent = 0;
+
+#define ZS_CLASSES   8
+#define ZS_GRANULE   (SIMPAGESIZE / ZS_CLASSES)
+#define ZS_SLAB_OBJS 64
+#define ZS_SLAB_SHARE 4
+
+struct zslab {
+	char *mem;         // NULL if the slab is not allocated
+	unsigned cls;
+	unsigned nfree;
+	unsigned char free[ZS_SLAB_OBJS]; // Stack of free objects
+	int prev, next;    // In its class's list of slabs with free objects,
+	                   // or the list of unallocated slabs (next only)
+};
+
+struct zentry {
+	unsigned slot;     // Swap slot of the page
+	int slab;          // -1 if the entry is not in use
+	unsigned obj;
+	unsigned len;      // Compressed size
+	int prev, next;    // In the LRU list (or the free list, next only)
+};
+
+struct zswap {
+	size_t capacity;   // Largest pool size, in bytes
+	size_t size;       // Bytes in allocated slabs
+	unsigned slab_objs[ZS_CLASSES]; // Objects per slab, by class
+
+	struct zslab *slabs;
+	int nslabs;
+	int free_slabs;    // Unallocated slab structures
+	int partial[ZS_CLASSES]; // Slabs with free objects, by class
+
+	struct zentry *entries;
+	int nentries;
+	int free_entries;
+	int lru_head, lru_tail; // Least recently stored at the head
+	struct vpmap *slots;    // Swap slot -> entry
+
+	unsigned char scratch[LZ_BOUND(SIMPAGESIZE)];
+
+	// Statistics
+	unsigned long stores;
+	unsigned long rejects;     // Pages that did not compress
+	unsigned long full;        // Stores refused while the pool was full
+	unsigned long writebacks;  // Pages written to swap to make room
+	unsigned long loads;
+	unsigned long load_hits;
+	unsigned long bytes_in;
+	unsigned long bytes_out;   // Compressed bytes of the pages stored
+	size_t max_size;
+};
+
+static size_t class_size(unsigned cls)
+{
+	return (cls + 1) * ZS_GRANULE;
+}
+
+struct zswap *zswap_create(size_t capacity)
+{
+	if (capacity < SIMPAGESIZE) {
+		fprintf(stderr, "Error: compressed pool of %zu bytes cannot hold a page\n",
+		        capacity);
+		exit(1);
+	}
+	struct zswap *z = calloc(1, sizeof(struct zswap));
+	if (z == NULL) {
+		perror("zswap_create: malloc");
+		exit(1);
+	}
+	z->capacity = capacity;
+	z->free_slabs = z->free_entries = -1;
+	z->lru_head = z->lru_tail = -1;
+	for (int i = 0; i < ZS_CLASSES; i++) {
+		size_t objs = capacity / ZS_SLAB_SHARE / class_size(i);
+		z->slab_objs[i] = objs > ZS_SLAB_OBJS ? ZS_SLAB_OBJS : objs ? objs : 1;
+		z->partial[i] = -1;
+	}
+	z->slots = vpmap_create(capacity / SIMPAGESIZE);
+	return z;
+}
+
+void zswap_destroy(struct zswap *z)
+{
+	for (int i = 0; i < z->nslabs; i++) {
+		free(z->slabs[i].mem);
+	}
+	free(z->slabs);
+	free(z->entries);
+	vpmap_destroy(z->slots);
+	free(z);
+}
+
+static void partial_remove(struct zswap *z, int s)
+{
+	struct zslab *slab = &z->slabs[s];
+	if (slab->prev >= 0) {
+		z->slabs[slab->prev].next = slab->next;
+	} else {
+		z->partial[slab->cls] = slab->next;
+	}
+	if (slab->next >= 0) {
+		z->slabs[slab->next].prev = slab->prev;
+	}
+}
+
+static void partial_push(struct zswap *z, int s)
+{
+	struct zslab *slab = &z->slabs[s];
+	slab->prev = -1;
+	slab->next = z->partial[slab->cls];
+	if (slab->next >= 0) {
+		z->slabs[slab->next].prev = s;
+	}
+	z->partial[slab->cls] = s;
+}
+
+/* Allocates a new slab of class cls, if the pool has room for it.
+ * Returns its index, or -1.
+ */
+static int slab_create(struct zswap *z, unsigned cls)
+{
+	unsigned objs = z->slab_objs[cls];
+	size_t bytes = objs * class_size(cls);
+	if (z->size + bytes > z->capacity) {
+		return -1;
+	}
+	if (z->free_slabs < 0) {
+		int n = z->nslabs ? 2 * z->nslabs : 16;
+		struct zslab *slabs = realloc(z->slabs, n * sizeof(struct zslab));
+		if (slabs == NULL) {
+			perror("zswap: failed to allocate slabs");
+			exit(1);
+		}
+		for (int i = n - 1; i >= z->nslabs; i--) {
+			slabs[i].mem = NULL;
+			slabs[i].next = z->free_slabs;
+			z->free_slabs = i;
+		}
+		z->slabs = slabs;
+		z->nslabs = n;
+	}
+	int s = z->free_slabs;
+	struct zslab *slab = &z->slabs[s];
+	if ((slab->mem = malloc(bytes)) == NULL) {
+		perror("zswap: failed to allocate slab");
+		exit(1);
+	}
+	z->free_slabs = slab->next;
+	slab->cls = cls;
+	slab->nfree = objs;
+	for (unsigned i = 0; i < objs; i++) {
+		slab->free[i] = objs - 1 - i;
+	}
+	partial_push(z, s);
+	z->size += bytes;
+	if (z->size > z->max_size) {
+		z->max_size = z->size;
+	}
+	return s;
+}
+
+static void obj_free(struct zswap *z, int s, unsigned obj)
+{
+	struct zslab *slab = &z->slabs[s];
+	if (slab->nfree == 0) {
+		partial_push(z, s);
+	}
+	slab->free[slab->nfree++] = obj;
+	if (slab->nfree == z->slab_objs[slab->cls]) {
+		// Give the whole slab back to the pool
+		partial_remove(z, s);
+		z->size -= slab->nfree * class_size(slab->cls);
+		free(slab->mem);
+		slab->mem = NULL;
+		slab->next = z->free_slabs;
+		z->free_slabs = s;
+	}
+}
+
+static int entry_alloc(struct zswap *z)
+{
+	if (z->free_entries < 0) {
+		int n = z->nentries ? 2 * z->nentries : 64;
+		struct zentry *entries = realloc(z->entries, n * sizeof(struct zentry));
+		if (entries == NULL) {
+			perror("zswap: failed to allocate entries");
+			exit(1);
+		}
+		for (int i = n - 1; i >= z->nentries; i--) {
+			entries[i].slab = -1;
+			entries[i].next = z->free_entries;
+			z->free_entries = i;
+		}
+		z->entries = entries;
+		z->nentries = n;
+	}
+	int e = z->free_entries;
+	z->free_entries = z->entries[e].next;
+	return e;
+}
+
+/* Frees entry e and its object, taking it off the LRU list. */
+static void entry_free(struct zswap *z, int e)
+{
+	struct zentry *ent = &z->entries[e];
+
+	if (ent->prev >= 0) {
+		z->entries[ent->prev].next = ent->next;
+	} else {
+		z->lru_head = ent->next;
+	}
+	if (ent->next >= 0) {
+		z->entries[ent->next].prev = ent->prev;
+	} else {
+		z->lru_tail = ent->prev;
+	}
+	vpmap_remove(z->slots, ent->slot);
+	obj_free(z, ent->slab, ent->obj);
+	ent->slab = -1;
+	ent->next = z->free_entries;
+	z->free_entries = e;
+}
+
+/* Compresses page and stores it in the pool under swap slot, replacing
+ * any copy there already. Returns 0 if it was stored, -1 if the page does
+ * not compress, or 1 if the pool is full (see zswap_evict()).
+ */
+int zswap_store(struct zswap *z, unsigned slot, const void *page)
+{
+	zswap_invalidate(z, slot);
+
+	size_t len = lz_compress(page, SIMPAGESIZE, z->scratch);
+	if (len >= SIMPAGESIZE) {
+		z->rejects++;
+		return -1;
+	}
+	unsigned cls = (len + ZS_GRANULE - 1) / ZS_GRANULE - 1;
+	int s = z->partial[cls];
+	if (s < 0 && (s = slab_create(z, cls)) < 0) {
+		z->full++;
+		return 1;
+	}
+
+	struct zslab *slab = &z->slabs[s];
+	unsigned obj = slab->free[--slab->nfree];
+	if (slab->nfree == 0) {
+		partial_remove(z, s);
+	}
+	memcpy(slab->mem + obj * class_size(cls), z->scratch, len);
+
+	int e = entry_alloc(z);
+	struct zentry *ent = &z->entries[e];
+	ent->slot = slot;
+	ent->slab = s;
+	ent->obj = obj;
+	ent->len = len;
+	ent->prev = z->lru_tail;
+	ent->next = -1;
+	if (z->lru_tail >= 0) {
+		z->entries[z->lru_tail].next = e;
+	} else {
+		z->lru_head = e;
+	}
+	z->lru_tail = e;
+	vpmap_put(z->slots, slot, e);
+
+	z->stores++;
+	z->bytes_in += SIMPAGESIZE;
+	z->bytes_out += len;
+	return 0;
+}
+
+/* Takes the least recently stored page out of the pool, to be written to
+ * its slot in swap. Returns 1 with the page in page and its slot in *slot,
+ * or 0 if the pool is empty.
+ */
+int zswap_evict(struct zswap *z, void *page, unsigned *slot)
+{
+	int e = z->lru_head;
+	if (e < 0) {
+		return 0;
+	}
+	struct zentry *ent = &z->entries[e];
+	struct zslab *slab = &z->slabs[ent->slab];
+	long n = lz_decompress(slab->mem + ent->obj * class_size(slab->cls),
+	                       ent->len, page, SIMPAGESIZE);
+	assert(n == SIMPAGESIZE);
+	*slot = ent->slot;
+	entry_free(z, e);
+	z->writebacks++;
+	return 1;
+}
+
+/* Copies the page stored under swap slot into page. Returns 1 if the pool
+ * has it, or 0 if it must be read from swap.
+ */
+int zswap_load(struct zswap *z, unsigned slot, void *page)
+{
+	long e;
+
+	z->loads++;
+	if (!vpmap_get(z->slots, slot, &e)) {
+		return 0;
+	}
+	struct zentry *ent = &z->entries[e];
+	struct zslab *slab = &z->slabs[ent->slab];
+	long n = lz_decompress(slab->mem + ent->obj * class_size(slab->cls),
+	                       ent->len, page, SIMPAGESIZE);
+	assert(n == SIMPAGESIZE);
+	z->load_hits++;
+	return 1;
+}
+
+/* Drops any copy of swap slot from the pool, when the slot is freed. */
+void zswap_invalidate(struct zswap *z, unsigned slot)
+{
+	long e;
+	if (vpmap_get(z->slots, slot, &e)) {
+		entry_free(z, e);
+	}
+}
+
+void zswap_print_stats(struct zswap *z)
+{
+	printf("Compressed pool stores: %lu (%lu incompressible, %lu refused while full)\n",
+	       z->stores, z->rejects, z->full);
+	printf("Compression ratio: %.2f\n",
+	       z->bytes_out ? (double)z->bytes_in / z->bytes_out : 0.0);
+	printf("Compressed pool hit rate: %.4f (%lu of %lu swap reads)\n",
+	       z->loads ? (double)z->load_hits / z->loads * 100 : 0.0,
+	       z->load_hits, z->loads);
+	printf("Compressed pool size: %zu bytes (largest %zu of %zu)\n",
+	       z->size, z->max_size, z->capacity);
+	printf("Pages written back to swap: %lu\n", z->writebacks);
+	printf("Swap I/Os avoided: %lu (%lu writes, %lu reads)\n",
+	       z->stores - z->writebacks + z->load_hits,
+	       z->stores - z->writebacks, z->load_hits);
+}
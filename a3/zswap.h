@@ -0,0 +1,17 @@
+#ifndef __ZSWAP_H__
+#define __ZSWAP_H__
+
+/* A compressed pool of swapped-out pages, kept in memory in front of the
+ * swap area (see zswap.c). Pages are identified by their swap slot.
+ */
+struct zswap;
+
+struct zswap *zswap_create(size_t capacity);
+void zswap_destroy(struct zswap *z);
+int zswap_store(struct zswap *z, unsigned slot, const void *page);
+int zswap_evict(struct zswap *z, void *page, unsigned *slot);
+int zswap_load(struct zswap *z, unsigned slot, void *page);
+void zswap_invalidate(struct zswap *z, unsigned slot);
+void zswap_print_stats(struct zswap *z);
+
+#endif /* __ZSWAP_H__ */